@@ -34,6 +34,9 @@
  */
 
 #include <dlfcn.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <ctype.h>
 #include <arpa/inet.h>
 
 #include "util.h"
@@ -54,6 +57,27 @@ int jit_asm(EMITTER emit,void *data,int len)
 #define EDICT_OPS "@/!&|^"
 #define EDICT_MONO_OPS "()<>"
 
+// an atom that reads completely as a number compiles to a native immediate (LT_I64/LT_F64);
+// integers are decimal unless prefixed 0x, so a leading zero never means octal
+static LTV_FLAGS numeric(char *data,int len,void **imm)
+{
+    char *buf,*end;
+    LT_IMMVAL val;
+    int sign=len && (data[0]=='-' || data[0]=='+');
+    if (len<=sign || !(isdigit(data[sign]) || (data[sign]=='.' && len>sign+1 && isdigit(data[sign+1]))))
+        return LT_NONE;
+    int hex=len>sign+2 && data[sign]=='0' && (data[sign+1]=='x' || data[sign+1]=='X');
+    (void) PRINTA(buf,len,data);
+    errno=0;
+    val.i=strtoll(buf,&end,hex?16:10);
+    if (!*end && !errno)
+        return *imm=val.data,LT_IMM|LT_I64;
+    val.d=strtod(buf,&end);
+    if (!*end)
+        return *imm=val.data,LT_IMM|LT_F64;
+    return LT_NONE;
+}
+
 int jit_edict(EMITTER emit,void *data,int len)
 {
     int status=0;
@@ -87,6 +111,8 @@ int jit_edict(EMITTER emit,void *data,int len)
                 ref_len+=tlen;
 
             tlen=ops_len+ref_len;
+            void *imm=NULL;
+            LTV_FLAGS imm_flags;
 
             if (!ops_len && ref_len==2 && tdata[0]=='$') { // possible keyword
                 switch (tdata[1]) {
@@ -97,8 +123,13 @@ int jit_edict(EMITTER emit,void *data,int len)
                     case 'D': EMIT(S2D); advance(ref_len); goto done; // stack -> TOS[dict]
                     case 'E': EMIT(S2E); advance(ref_len); goto done; // stack -> TOS[excp]
                     case 'F': EMIT(S2F); advance(ref_len); goto done; // stack -> TOS[func]
+                    case 'm': EMIT(MAP); advance(ref_len); goto done; // TOS(func) over lists/arrays beneath it
                     default: break;
                 }
+            } else if (!ops_len && (imm_flags=numeric(tdata,ref_len,&imm))) { // number; no lookup, no parsing at runtime
+                EMIT_EXT((char *) &imm,sizeof(imm),imm_flags); EMIT(PUSHEXT);
+                advance(ref_len);
+                goto done;
             } else if (ref_len) {
                 EMIT_EXT(tdata,ref_len,LT_DUP);
                 advance(ref_len);
@@ -298,7 +329,7 @@ LTV *compile_ltv(COMPILER compiler, LTV *ltv) {
 }
 
 char *opcode_name[] = {"RESET", "YIELD", "EXT", "THROW", "CATCH", "PUSHEXT", "EVAL", "REF", "DEREF", "ASSIGN", "REMOVE", "CTX_PUSH", "CTX_POP", "FUN_PUSH", "FUN_EVAL", "FUN_POP",
-                       "S2S", "D2S", "E2S", "F2S", "S2D", "S2E", "S2F"};
+                       "S2S", "D2S", "E2S", "F2S", "S2D", "S2E", "S2F", "MAP"};
 
 void disassemble(FILE *ofile, LTV *ltv) {
     TSTART(0, "disassemble");
@@ -317,7 +348,13 @@ void disassemble(FILE *ofile, LTV *ltv) {
                 i += length;
                 // fprintf(ofile, "\n" CODE_BLUE);
                 fprintf(ofile, CODE_BLUE);
-                fstrnprint(ofile, data, length);
+                if (flags & LT_NUM) {
+                    LT_IMMVAL val;
+                    memcpy(&val.data, data, sizeof(val.data));
+                    if (flags & LT_I64) fprintf(ofile, "%lld", val.i);
+                    else                fprintf(ofile, "%g", val.d);
+                } else
+                    fstrnprint(ofile, data, length);
                 fprintf(ofile, ":%x " CODE_RESET, flags);
                 break;
             case VMOP_RESET:
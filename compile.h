@@ -73,6 +73,7 @@ enum {
     VMOP_S2D,
     VMOP_S2E,
     VMOP_S2F,
+    VMOP_MAP,
 } VM_OPCODES;
 
 extern LTV *compile(COMPILER compiler,void *data,int len);
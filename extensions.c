@@ -36,6 +36,7 @@
 //#define _GNU_SOURCE
 #define _C99
 #include <libelf.h>
+#include <gelf.h>
 #include <elfutils/libdwelf.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -44,6 +45,9 @@
 #include <string.h>
 #include <stdlib.h>
 #include <dlfcn.h> // dlopen/dlsym/dlclose
+#include <sched.h>
+#include <pthread.h>
+#include <urcu-bp.h> // rcu_barrier
 
 #include "util.h"
 #include "vm.h"
@@ -101,6 +105,12 @@ extern void printptr(char *var) { printf("%x\n",var); }
   - /usr/lib/debug/usr/bin/ls.debug.
 */
 
+static char *build_id_hex(char *buf,const unsigned char *id,int len) {
+    while (len-->0)
+        buf+=sprintf(buf,"%02x",*id++);
+    return buf;
+}
+
 // compiled separately because of it's use of libdwelf, which conflicts with libdwarf IIRC
 LTV *get_separated_debug_filename(char *filename)
 {
@@ -124,10 +134,8 @@ LTV *get_separated_debug_filename(char *filename)
                     }
                     LTV *buildid_filename=LTV_init(NEW(LTV),mymalloc(256),256,LT_OWN);
                     char *buf=(char *) buildid_filename->data;
-                    buf+=sprintf(buf,"/usr/lib/debug/.build-id/%02x",*((unsigned char *) buildid++));
-                    buf+=sprintf(buf,"/");
-                    while (--idlen)
-                        buf+=sprintf(buf,"%02x",*((unsigned char *) buildid++));
+                    buf+=sprintf(buf,"/usr/lib/debug/.build-id/%02x/",*((unsigned char *) buildid));
+                    buf=build_id_hex(buf,(unsigned char *) buildid+1,idlen-1);
                     buf+=sprintf(buf,".debug");
                     buildid_filename->len=buf-(char *) (buildid_filename->data);
                     LT_put(debug_filename,"buildid",TAIL,buildid_filename);
@@ -141,6 +149,57 @@ LTV *get_separated_debug_filename(char *filename)
     return debug_filename;
 }
 
+// filename's GNU build-id as a hex string, or NULL if it has none
+LTV *get_build_id(char *filename)
+{
+    LTV *build_id=NULL;
+    if ( elf_version ( EV_CURRENT ) != EV_NONE ) {
+        int fd=open(filename,O_RDONLY);
+        if (fd>=0) {
+            Elf *elf=elf_begin(fd,ELF_C_READ,NULL);
+            if (elf) {
+                const void *id;
+                ssize_t idlen=dwelf_elf_gnu_build_id(elf,&id);
+                if (idlen>0) {
+                    build_id=LTV_init(NEW(LTV),mymalloc(idlen*2+1),idlen*2,LT_OWN);
+                    build_id_hex((char *) build_id->data,(unsigned char *) id,idlen);
+                }
+                elf_end(elf);
+            }
+            close(fd);
+        }
+    }
+    return build_id;
+}
+
+// a copy of filename's section "name", or NULL if it has none
+LTV *get_elf_section(char *filename,char *name)
+{
+    LTV *section=NULL;
+    if ( elf_version ( EV_CURRENT ) != EV_NONE ) {
+        int fd=open(filename,O_RDONLY);
+        if (fd>=0) {
+            Elf *elf=elf_begin(fd,ELF_C_READ,NULL);
+            size_t shstrndx;
+            if (elf && !elf_getshdrstrndx(elf,&shstrndx)) {
+                for (Elf_Scn *scn=NULL;!section && (scn=elf_nextscn(elf,scn));) {
+                    GElf_Shdr shdr;
+                    char *scn_name;
+                    Elf_Data *data;
+                    if (gelf_getshdr(scn,&shdr) && shdr.sh_type!=SHT_NOBITS &&
+                        (scn_name=elf_strptr(elf,shstrndx,shdr.sh_name)) && !strcmp(scn_name,name) &&
+                        (data=elf_getdata(scn,NULL)) && data->d_buf && data->d_size)
+                        section=LTV_init(NEW(LTV),bufdup(data->d_buf,data->d_size),data->d_size,LT_OWN|LT_BIN);
+                }
+            }
+            if (elf)
+                elf_end(elf);
+            close(fd);
+        }
+    }
+    return section;
+}
+
 extern LTV *null() { return LTV_NULL; }
 extern void is_null(LTV *tos) { if (!(tos->flags&LT_NULL)) vm_throw(LTV_NULL); }
 
@@ -169,5 +228,60 @@ extern void bench() {
     return;
 }
 
+// "n" keys under one dict, for timing wildcard walks (see wildbench)
+extern LTV *bench_dict(int n) {
+    LTV *dict=LTV_NULL;
+    char key[16];
+    for (int i=0;i<n;i++) {
+        snprintf(key,sizeof(key),"%08d",i);
+        LT_put(dict,key,HEAD,LTV_NULL);
+    }
+    return dict;
+}
+
+// "threads" workers churning private dicts that all hold one shared ltv; checks refs and counters balance (see threadbench)
+extern int bench_threads(int threads) {
+    int status=0;
+    long ltvs=stat_read(STAT_LTV),ltvrs=stat_read(STAT_LTVR),ltis=stat_read(STAT_LTI);
+    pthread_t worker[threads];
+    LTV *shared=LTV_NULL;
+    CLL anchor;
+    CLL_init(&anchor);
+    LTV_enq(&anchor,shared,HEAD);
+    LT_put(shared,"payload",HEAD,LTV_NULL);
+
+    void *churn(void *arg) {
+        char key[16];
+        for (int i=0;i<100000;i++) {
+            LTV *dict=LTV_NULL;
+            snprintf(key,sizeof(key),"%d",i&0xff);
+            LT_put(dict,"shared",HEAD,shared);
+            LT_put(dict,key,HEAD,LTV_NULL);
+            LTV_release(dict);
+        }
+        return NULL;
+    }
+
+    int spawned=0,refs=0,concurrent=lt_concurrent_enter(false);
+    while (spawned<threads && !pthread_create(&worker[spawned],NULL,churn,NULL))
+        spawned++;
+    for (int i=0;i<spawned;i++) // churn runs on this frame, so always join before leaving
+        pthread_join(worker[i],NULL);
+    while (LTV_reclaim(-1)) // workers' dicts may still be queued, or in the background reclaimer's hands
+        sched_yield();
+    refs=shared->refs;
+    LTV_release(LTV_deq(&anchor,HEAD));
+    while (LTV_reclaim(-1))
+        sched_yield();
+    rcu_barrier(); // let deferred frees land before counting
+    lt_concurrent_restore(concurrent);
+    STRY(spawned<threads,"spawning workers");
+    STRY(refs!=1,"validating shared refs (%d)",refs);
+    fprintf(outfile(),"%d threads: ltv %+ld lti %+ld ltvr %+ld\n",threads,
+            stat_read(STAT_LTV)-ltvs,stat_read(STAT_LTI)-ltis,stat_read(STAT_LTVR)-ltvrs);
+ done:
+    return status;
+}
+
 test_callback_sig callback_example=NULL;
 extern int test_callback(int a,int b) { return callback_example? callback_example(a,b):0; }
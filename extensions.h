@@ -37,6 +37,8 @@
 #define EXTENSIONS_H
 
 extern LTV *get_separated_debug_filename(char *filename);
+extern LTV *get_build_id(char *filename); // hex GNU build-id, or NULL
+extern LTV *get_elf_section(char *filename,char *name); // copy of a section's contents, or NULL
 typedef int (*test_callback_sig)(int a,int b);
 extern test_callback_sig example_callback;
 
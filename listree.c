@@ -39,6 +39,14 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <urcu-bp.h> // rcu_read_lock, call_rcu
 #include "util.h"
 #include "listree.h"
 #include "reflect.h"
@@ -47,7 +55,147 @@
 #include "trace.h" // lttng
 
 int show_ref=0;
-int lti_count=0,ltvr_count=0,ltv_count=0;
+
+//////////////////////////////////////////////////
+// Concurrency
+// Writers serialize per container on a striped mutex, and anything a reader
+// might still be looking at is handed to call_rcu instead of being freed.
+// LT_HASH lookups are lock-free RCU readers (a resize publishes a whole new
+// slot table). AA trees rebalance in place, and a rotation can briefly hide a
+// node from a walk, so AA lookups and seeks take the container's stripe too.
+// Either way a found LTI is only safe inside a read-side section that lasts
+// through its last use (LT_read_lock), since removal hands it to call_rcu.
+// All of it stays dormant (plain single-threaded paths) until lt_concurrent.
+//////////////////////////////////////////////////
+
+int lt_concurrent=0; // set while a second thread can see shared trees (vm_async, import workers); see lt_concurrent_enter
+static int lt_concurrent_pinned=0; // some thread (vm_async) may outlive whoever started it; concurrent mode is one-way from here
+
+#define LT_STRIPES 64
+
+typedef struct { pthread_mutex_t mutex; } LT_STRIPE;
+static LT_STRIPE lt_stripe[LT_STRIPES]={[0 ... LT_STRIPES-1]={PTHREAD_MUTEX_INITIALIZER}};
+
+static LT_STRIPE *lt_stripe_of(void *key) { return &lt_stripe[(((uintptr_t) key)*0x9e3779b97f4a7c15ULL)>>58]; }
+
+// returns the held stripe (NULL when single-threaded) for lt_unlock
+static LT_STRIPE *lt_lock(void *key) {
+    if (!LT_CONCURRENT)
+        return NULL;
+    LT_STRIPE *stripe=lt_stripe_of(key);
+    pthread_mutex_lock(&stripe->mutex);
+    return stripe;
+}
+
+static void lt_unlock(LT_STRIPE *stripe) { if (stripe) pthread_mutex_unlock(&stripe->mutex); }
+
+// read-side section; returns whether one was entered (lt_concurrent may be set meanwhile) for lt_rcu_unlock
+static int lt_rcu_lock() {
+    if (!LT_CONCURRENT)
+        return false;
+    rcu_read_lock();
+    return true;
+}
+
+static void lt_rcu_unlock(int locked) { if (locked) rcu_read_unlock(); }
+
+int LT_read_lock() { return lt_rcu_lock(); }
+void LT_read_unlock(int locked) { lt_rcu_unlock(locked); }
+
+typedef struct { struct rcu_head rcu; void (*reclaim)(void *); void *ptr; } LT_DEFER;
+
+static void lt_reclaim(struct rcu_head *rcu) {
+    LT_DEFER *defer=caa_container_of(rcu,LT_DEFER,rcu);
+    defer->reclaim(defer->ptr);
+    DELETE(defer);
+}
+
+// hand ptr to call_rcu if readers may still hold it; false means "reclaim it now"
+static int lt_defer(void (*reclaim)(void *),void *ptr) {
+    LT_DEFER *defer=NULL;
+    if (!LT_CONCURRENT || !ptr || !(defer=(LT_DEFER *) mymalloc(sizeof(LT_DEFER))))
+        return false;
+    defer->reclaim=reclaim;
+    defer->ptr=ptr;
+    call_rcu(&defer->rcu,lt_reclaim);
+    return true;
+}
+
+static void lt_myfree(void *ptr) { DELETE(ptr); }
+
+// mapped listree images (see image_ltv_map); their nodes live in the mapping and are never freed.
+// The table is sorted by base and replaced whole on every map, so lookups only need RCU.
+typedef struct { char *base; size_t len; } LT_IMAGE;
+typedef struct { int n; LT_IMAGE image[]; } LT_IMAGES;
+static LT_IMAGES *lt_images=NULL;
+static pthread_mutex_t lt_image_mutex=PTHREAD_MUTEX_INITIALIZER;
+
+static LT_IMAGE *lt_image_find(LT_IMAGES *images,void *ptr) { // image whose range holds ptr
+    int lo=0,hi=images?images->n:0;
+    while (lo<hi) { // first image based beyond ptr
+        int mid=(lo+hi)/2;
+        if (images->image[mid].base<=(char *) ptr)
+            lo=mid+1;
+        else
+            hi=mid;
+    }
+    LT_IMAGE *image=lo?&images->image[lo-1]:NULL;
+    return image && (char *) ptr<image->base+image->len?image:NULL;
+}
+
+static int lt_imaged(void *ptr) {
+    if (!__atomic_load_n(&lt_images,__ATOMIC_RELAXED))
+        return false;
+    int locked=lt_rcu_lock();
+    int imaged=lt_image_find(__atomic_load_n(&lt_images,__ATOMIC_ACQUIRE),ptr)!=NULL;
+    lt_rcu_unlock(locked);
+    return imaged;
+}
+
+// publish a copy of the table with "add" inserted in base order; under lt_image_mutex
+static int lt_image_add(LT_IMAGE add) {
+    LT_IMAGES *old=lt_images,*new=NULL;
+    int n=old?old->n:0,i=0;
+    if (!(new=(LT_IMAGES *) mymalloc(sizeof(LT_IMAGES)+(n+1)*sizeof(LT_IMAGE))))
+        return TRY_ERR;
+    for (;i<n && old->image[i].base<add.base;i++)
+        new->image[i]=old->image[i];
+    new->image[i]=add;
+    for (;i<n;i++)
+        new->image[i+1]=old->image[i];
+    new->n=n+1;
+    __atomic_store_n(&lt_images,new,__ATOMIC_RELEASE);
+    if (old && !lt_defer(lt_myfree,old))
+        DELETE(old);
+    return 0;
+}
+
+// LTV.refs: holds are relaxed, drops are acq_rel so whoever frees sees every prior write.
+// LTV_release claims a zero count by swapping in LTV_DYING; a hold never revives a dying LTV.
+#define LTV_DYING (-1)
+
+static int ltv_hold(LTV *ltv) {
+    if (!LT_CONCURRENT)
+        return ltv->refs!=LTV_DYING && ++ltv->refs;
+    int refs=__atomic_load_n(&ltv->refs,__ATOMIC_RELAXED);
+    do if (refs==LTV_DYING) return false;
+    while (!__atomic_compare_exchange_n(&ltv->refs,&refs,refs+1,true,__ATOMIC_RELAXED,__ATOMIC_RELAXED));
+    return true;
+}
+
+static int ltv_drop(LTV *ltv) { return LT_CONCURRENT?__atomic_sub_fetch(&ltv->refs,1,__ATOMIC_ACQ_REL):--ltv->refs; }
+
+static int ltv_claim(LTV *ltv) {
+    int zero=0;
+    if (LT_CONCURRENT)
+        return __atomic_compare_exchange_n(&ltv->refs,&zero,LTV_DYING,false,__ATOMIC_ACQUIRE,__ATOMIC_RELAXED);
+    return !ltv->refs && (ltv->refs=LTV_DYING);
+}
+
+// LTV.cows counts only snapshot links, so plain aliasing (stacks, refs, LTV_dup'ed lists) never reads as shared
+static void ltv_cows(LTV *ltv,int delta) { if (LT_CONCURRENT) __atomic_add_fetch(&ltv->cows,delta,__ATOMIC_ACQ_REL); else ltv->cows+=delta; }
+static int ltv_shared(LTV *ltv) { return (LT_CONCURRENT?__atomic_load_n(&ltv->cows,__ATOMIC_ACQUIRE):ltv->cows)>1; }
+#define LT_DELETE(var) ((void) (lt_defer(lt_myfree,(var)) || (DELETE(var),0)),(var)=NULL)
 
 //////////////////////////////////////////////////
 // LisTree
@@ -58,7 +206,7 @@ int lti_count=0,ltvr_count=0,ltv_count=0;
 
 static LTI aa_sentinel={.lnk={&aa_sentinel,&aa_sentinel},.level=0};
 
-int LTI_invalid(LTI *lti) { return lti==NULL || lti==&aa_sentinel; }
+int LTI_invalid(LTI *lti) { return lti==NULL || lti==&aa_sentinel || !lti->level; } // level 0: a sentinel (images carry their own)
 
 static void aa_rot(LTI **t,int dir) {
     LTI *temp=(*t);
@@ -79,33 +227,26 @@ static void aa_split(LTI **t) {
     }
 }
 
-static LTI *aa_most(LTI *t,int dir) {
-    if (t==&aa_sentinel)
-        return t;
-    LTI *lti=aa_most(t->lnk[dir],dir);
-    return lti==&aa_sentinel?t:lti;
-}
-
 // find "name" in "t"; walk until we hit target or find sentinel; optionally inserting there
-static LTI *aa_find(LTI **t,char *name,int len,int *insert) {
+// "next" tracks the closest greater node seen on the way down, i.e. an inserted node's successor
+static LTI *aa_find(LTI **t,char *name,int len,int *insert,LTI **next) {
     LTI *lti=NULL;
-    int iter=(*insert)&ITER;
-    int dir=(*insert)&1;
-    if ((*t)==&aa_sentinel) // at edge... either insert or return NULL
+    if (LTI_invalid(*t)) // at edge... either insert or return NULL
         lti=((*insert)&INSERT)?(*t)=LTI_init(NEW(LTI),name,len):NULL;
     else {
         int delta=0;
-        for (int i=0;delta==0 && i<PREVIEWLEN && i<len && i<(*t)->len;i++)
-            delta=name[i]-(*t)->preview[i];
-        if (!delta) // preview matched, compare full strings
-            delta=strnncmp(name,len,(*t)->name,(*t)->len);
+        if (name!=(*t)->name || len!=(*t)->len) { // interned key matches by pointer (and length; it may be a prefix)
+            for (int i=0;delta==0 && i<PREVIEWLEN && i<len && i<(*t)->len;i++)
+                delta=(unsigned char) name[i]-(*t)->preview[i]; // unsigned, like strnncmp (and so LTI_seek)
+            if (!delta) // preview matched, compare full strings
+                delta=strnncmp(name,len,(*t)->name,(*t)->len);
+        }
         int deltadir=delta<0?LEFT:RIGHT; // turn LTZ/Z/GTZ into left/right/right
         if (delta) {
-            if (LTI_invalid(lti=aa_find(&(*t)->lnk[deltadir],name,len,insert)) && iter && dir!=deltadir)
-                lti=*t;
+            if (deltadir==LEFT)
+                *next=*t;
+            lti=aa_find(&(*t)->lnk[deltadir],name,len,insert,next);
         }
-        else if (iter) // matches, but find next smaller/larger
-            lti=aa_most((*t)->lnk[dir],!dir);
         else // return match
             lti=(*t),(*insert)=0;
     }
@@ -128,16 +269,19 @@ static LTI *aa_remove(LTI **t,char *name,int len,int match) {
 
     // descend tree, finding matching node ("toremove") and then "next-greater" leaf ("tokeep")
     int delta=0;
-    for (int i=0;delta==0 && i<PREVIEWLEN && i<len && i<(*t)->len;i++)
-        delta=name[i]-(*t)->preview[i];
-    if (!delta) // preview matched, compare full strings
-        delta=strnncmp(name,len,(*t)->name,(*t)->len);
+    if (name!=(*t)->name || len!=(*t)->len) { // interned key matches by pointer (and length; it may be a prefix)
+        for (int i=0;delta==0 && i<PREVIEWLEN && i<len && i<(*t)->len;i++)
+            delta=(unsigned char) name[i]-(*t)->preview[i];
+        if (!delta) // preview matched, compare full strings
+            delta=strnncmp(name,len,(*t)->name,(*t)->len);
+    }
     result=aa_remove(&(*t)->lnk[delta<0?LEFT:RIGHT],name,len,match|!delta);
 
     if (!delta) { // matching node
         if (result!=&aa_sentinel) { // swap with leaf...
             result->lnk[LEFT]=(*t)->lnk[LEFT];
             result->lnk[RIGHT]=(*t)->lnk[RIGHT];
+            result->level=(*t)->level;
             (*t)->lnk[LEFT]=&aa_sentinel;
             (*t)->lnk[RIGHT]=&aa_sentinel;
         }
@@ -146,7 +290,8 @@ static LTI *aa_remove(LTI **t,char *name,int len,int match) {
         result=newresult;
     } else if (match && result==&aa_sentinel) {
         result=*t;
-        *t=&aa_sentinel;
+        *t=result->lnk[RIGHT]; // leaf may still carry a horizontal right link
+        result->lnk[RIGHT]=&aa_sentinel;
     }
 
  cleanup:
@@ -189,34 +334,433 @@ static void *aa_map(LTI *lti,LTI_OP op,int dir)
     return aa_metamap(&lti,metaop,dir);
 }
 
+//////////////////////////////////////////////////
+// Sorted LTI ring
+// Every LTV's LTIs are also threaded, in name order, into a circular list
+// anchored at sub.first, so first/last/next/prev never re-descend the tree.
+//////////////////////////////////////////////////
+
+// link "lti" in just before "next" (NULL: lti is greatest)
+static void ring_link(LTV *ltv,LTI *lti,LTI *next) {
+    LTI *first=ltv->sub.first;
+    if (!first)
+        lti->thread[FWD]=lti->thread[REV]=ltv->sub.first=lti;
+    else {
+        LTI *succ=next?next:first,*pred=succ->thread[REV];
+        lti->thread[FWD]=succ;
+        lti->thread[REV]=pred;
+        pred->thread[FWD]=succ->thread[REV]=lti;
+        if (next==first)
+            ltv->sub.first=lti;
+    }
+}
+
+static void ring_unlink(LTV *ltv,LTI *lti) {
+    if (lti->thread[FWD]==lti)
+        ltv->sub.first=NULL;
+    else {
+        lti->thread[REV]->thread[FWD]=lti->thread[FWD];
+        lti->thread[FWD]->thread[REV]=lti->thread[REV];
+        if (ltv->sub.first==lti)
+            ltv->sub.first=lti->thread[FWD];
+    }
+    lti->thread[FWD]=lti->thread[REV]=NULL;
+}
+
+//////////////////////////////////////////////////
+// Hash-indexed children (LT_HASH)
+// Same LTIs as the AA tree, but found via open addressing on the interned
+// name's hash; the sorted ring is (re)built only when an ordered walk asks
+// for it.
+//////////////////////////////////////////////////
+
+static LTI lth_tombstone;
+
+static int lti_cmp(const void *a,const void *b) {
+    LTI *x=*(LTI **) a,*y=*(LTI **) b;
+    return strnncmp(x->name,x->len,y->name,y->len);
+}
+
+// returns matching slot, or NULL and (optionally) the first reusable slot along the probe
+static LTI **lth_probe(LTI_SLOTS *slots,char *name,int len,unsigned code,LTI ***vacant) {
+    if (vacant) *vacant=NULL;
+    for (unsigned i=code&slots->mask;;i=(i+1)&slots->mask) {
+        LTI **slot=&slots->slot[i];
+        if (*slot==&lth_tombstone) {
+            if (vacant && !*vacant) *vacant=slot;
+        } else if (!*slot) {
+            if (vacant && !*vacant) *vacant=slot;
+            return NULL;
+        } else if ((*slot)->len==len && ((*slot)->name==name ||
+                   (strinterned_hash((*slot)->name)==code && !memcmp((*slot)->name,name,len))))
+            return slot;
+    }
+}
+
+// rehash into a fresh table (which may be smaller, once tombstones are dropped) and publish it whole
+static LTI_HASH *lth_resize(LTI_HASH *hash) {
+    unsigned size=16;
+    while (size<(hash->count+1)*2)
+        size*=2;
+    LTI_SLOTS *old=hash->slots,*slots=(LTI_SLOTS *) mymalloc(sizeof(LTI_SLOTS)+size*sizeof(LTI *));
+    if (!slots)
+        return NULL;
+    slots->mask=size-1;
+    for (unsigned i=0;old && i<=old->mask;i++) {
+        LTI *lti=old->slot[i];
+        if (lti && lti!=&lth_tombstone) {
+            unsigned j=strinterned_hash(lti->name)&slots->mask;
+            while (slots->slot[j])
+                j=(j+1)&slots->mask;
+            slots->slot[j]=lti;
+        }
+    }
+    __atomic_store_n(&hash->slots,slots,__ATOMIC_RELEASE);
+    LT_DELETE(old); // readers still probing it keep a complete (if stale) snapshot
+    hash->used=hash->count;
+    return hash;
+}
+
+static void lth_free(LTV *ltv) {
+    if (ltv->sub.hash) {
+        LT_DELETE(ltv->sub.hash->slots);
+        LT_DELETE(ltv->sub.hash->sorted);
+        LT_DELETE(ltv->sub.hash);
+    }
+    ltv->sub.first=NULL;
+}
+
+// reader-side probe, inside an RCU read section; a concurrent resize just leaves it on the previous table
+static LTI *lth_lookup(LTV *ltv,char *name,int len) {
+    LTI_HASH *hash=__atomic_load_n(&ltv->sub.hash,__ATOMIC_ACQUIRE);
+    LTI_SLOTS *slots=hash?__atomic_load_n(&hash->slots,__ATOMIC_ACQUIRE):NULL;
+    if (!slots)
+        return NULL;
+    unsigned code=strnhash(name,len);
+    LTI *lti=NULL;
+    for (unsigned i=code&slots->mask,n=0;n<=slots->mask;i=(i+1)&slots->mask,n++) {
+        if (!(lti=__atomic_load_n(&slots->slot[i],__ATOMIC_ACQUIRE)))
+            break;
+        if (lti!=&lth_tombstone && lti->len==len && (lti->name==name || !memcmp(lti->name,name,len)))
+            return lti;
+    }
+    return NULL;
+}
+
+static LTI *lth_find(LTV *ltv,char *name,int len,int insert) {
+    LTI_HASH *hash=ltv->sub.hash;
+    LTI **slot=NULL,**vacant=NULL,*lti=NULL;
+    unsigned code=strnhash(name,len);
+    if (hash && hash->slots && (slot=lth_probe(hash->slots,name,len,code,&vacant)))
+        return *slot;
+    if (!insert)
+        return NULL;
+    if (!hash && !(hash=ltv->sub.hash=NEW(LTI_HASH)))
+        return NULL;
+    if (!hash->slots || (hash->used+1)*4>(hash->slots->mask+1)*3) { // keep load under 3/4, tombstones included
+        if (!lth_resize(hash))
+            return NULL;
+        lth_probe(hash->slots,name,len,code,&vacant);
+    }
+    if (!(lti=LTI_init(NEW(LTI),name,len)))
+        return NULL;
+    if (*vacant!=&lth_tombstone)
+        hash->used++;
+    __atomic_store_n(vacant,lti,__ATOMIC_RELEASE);
+    hash->count++;
+    hash->ordered=false;
+    LT_DELETE(hash->sorted);
+    return lti;
+}
+
+static LTI *lth_remove(LTV *ltv,char *name,int len) {
+    LTI_HASH *hash=ltv->sub.hash;
+    LTI **slot=NULL,*lti=NULL;
+    if (!hash || !hash->slots || !(slot=lth_probe(hash->slots,name,len,strnhash(name,len),NULL)))
+        return NULL;
+    lti=*slot;
+    __atomic_store_n(slot,&lth_tombstone,__ATOMIC_RELEASE);
+    if (hash->ordered) // remaining order stays valid
+        ring_unlink(ltv,lti);
+    else // stale ring; lth_build rethreads the rest, but LTI_iter must still see this one as unlinked
+        lti->thread[FWD]=lti->thread[REV]=NULL;
+    LT_DELETE(hash->sorted);
+    if (!--hash->count)
+        lth_free(ltv);
+    return lti;
+}
+
+// (re)thread the sorted ring from the slot table; caller holds ltv's stripe
+static LTV *lth_build(LTV *ltv,LTI_HASH *hash) {
+    LTI **sorted=(LTI **) mymalloc(MAX(hash->count,1)*sizeof(LTI *));
+    unsigned n=0;
+    if (!sorted)
+        return NULL;
+    for (unsigned i=0;i<=hash->slots->mask;i++)
+        if (hash->slots->slot[i] && hash->slots->slot[i]!=&lth_tombstone)
+            sorted[n++]=hash->slots->slot[i];
+    qsort(sorted,n,sizeof(LTI *),lti_cmp);
+    for (unsigned i=0;i<n;i++) {
+        sorted[i]->thread[FWD]=sorted[(i+1)%n];
+        sorted[i]->thread[REV]=sorted[(i+n-1)%n];
+    }
+    ltv->sub.first=n?sorted[0]:NULL;
+    hash->sorted=sorted;
+    __atomic_store_n(&hash->ordered,true,__ATOMIC_RELEASE);
+    return ltv;
+}
+
+// bring an LT_HASH LTV's sorted ring up to date; no-op for AA trees
+static LTV *lth_order(LTV *ltv) {
+    LTI_HASH *hash=ltv->sub.hash;
+    if (!(ltv->flags&LT_HASH) || !hash || __atomic_load_n(&hash->ordered,__ATOMIC_ACQUIRE))
+        return ltv;
+    LT_STRIPE *stripe=lt_lock(ltv); // building the ring is a write, even when a reader asks for it
+    LTV *result=(hash=ltv->sub.hash) && !hash->ordered?lth_build(ltv,hash):ltv;
+    lt_unlock(stripe);
+    return result;
+}
+
+// sorted array view of the ring, for binary-search seeks; caller holds ltv's stripe
+static LTI **lth_index(LTV *ltv) {
+    LTI_HASH *hash=ltv->sub.hash;
+    if (hash && !hash->ordered && !lth_build(ltv,hash))
+        return NULL;
+    if (hash && !hash->sorted && (hash->sorted=(LTI **) mymalloc(hash->count*sizeof(LTI *)))) {
+        LTI *lti=ltv->sub.first;
+        for (unsigned i=0;i<hash->count;i++,lti=lti->thread[FWD])
+            hash->sorted[i]=lti;
+    }
+    return hash?hash->sorted:NULL;
+}
+
+static void *lth_map(LTV *ltv,LTI_OP op,int dir) {
+    void *rval=NULL;
+    LTI *lti=NULL,*next=NULL,*last=NULL;
+    dir&=1;
+    if (!lth_order(ltv) || !ltv->sub.first)
+        return NULL;
+    lti=dir?ltv->sub.first->thread[REV]:ltv->sub.first;
+    last=lti->thread[!dir];
+    for (;lti && !rval;lti=next) {
+        next=lti==last?NULL:lti->thread[dir]; // op can remove lti
+        rval=op(lti);
+    }
+    return rval;
+}
+
+// release up to *budget of a dead LT_HASH LTV's LTIs; true once the table is gone.
+// a dead table never takes inserts again, so "used" is recycled as the slot cursor
+static int lth_teardown(LTV *ltv,int *budget) {
+    LTI_HASH *hash=ltv->sub.hash;
+    if (hash && hash->count) // first step: live tables always have count>0
+        hash->count=hash->used=0;
+    for (;hash && hash->slots && *budget && hash->used<=hash->slots->mask;hash->used++,(*budget)--) {
+        LTI *lti=hash->slots->slot[hash->used];
+        if (lti && lti!=&lth_tombstone)
+            LTI_release(lti);
+    }
+    if (hash && hash->slots && hash->used<=hash->slots->mask)
+        return false;
+    lth_free(ltv);
+    return true;
+}
+
+LTI *(*LTV_lazy)(LTV *ltv,LTI *lti)=NULL;
+
+// the next step down an inserting path: unshare whatever lti's values are still linked from a snapshot
+static int lti_cow(LTI *lti)
+{
+    int status=0;
+    for (LTVR *ltvr=(LTVR *) CLL_next(&lti->ltvs,NULL,FWD);!status && ltvr;ltvr=(LTVR *) CLL_next(&lti->ltvs,&ltvr->lnk,FWD))
+        if (ltvr->cow)
+            status=!LTV_cow(ltvr);
+    return status;
+}
+
+// hand a LT_LAZY dict's lti to the materializer; runs inside LTV_find's read-side section, so it must never wait out a grace period
+static LTI *lti_lazy(LTV *ltv,LTI *lti) { return (ltv->flags&LT_LAZY) && LTV_lazy && !LTI_invalid(lti)?LTV_lazy(ltv,lti):lti; }
+
+// lookup without LTV_find's hooks (LTV_lazy, LTV_cow); lock-free for LT_HASH, under the stripe for AA trees.
+// The caller's read-side section (lt_rcu_lock) must span every use of the result.
+static LTI *ltv_lookup(LTV *ltv,char *name,int len)
+{
+    LTI *lti=NULL;
+    if (ltv->flags&LT_HASH)
+        lti=lth_lookup(ltv,name,len);
+    else {
+        int lookup=0;
+        LTI *next=NULL;
+        LT_STRIPE *stripe=lt_lock(ltv);
+        lti=aa_find(&ltv->sub.ltis,name,len,&lookup,&next);
+        lt_unlock(stripe);
+    }
+    return lti;
+}
+
 LTI *LTV_find(LTV *ltv,char *name,int len,int insert)
 {
-    int status;
+    int status,finding=!insert,locked=lt_rcu_lock(); // the lti can't be reclaimed while it's unshared or materialized
     LTI *lti=NULL;
     STRY(!ltv || !name || (ltv->flags&LT_LIST),"validating LTV_find parameters");
+    STRY(insert && ltv_shared(ltv),"inserting into an ltv shared with a snapshot (see LTV_cow)");
     if (len==-1)
         len=strlen(name);
-    insert=insert?INSERT:0; // true/false -> INSERT/0
-    lti=aa_find(&ltv->sub.ltis,name,len,&insert);
+    if (LT_CONCURRENT && (ltv->flags&LT_HASH)) { // lock-free lookup first; only inserts serialize
+        lti=ltv_lookup(ltv,name,len);
+        if (!LTI_invalid(lti) || !insert)
+            goto done;
+    }
+    LT_STRIPE *stripe=lt_lock(ltv);
+    if (ltv->flags&LT_HASH)
+        lti=lth_find(ltv,name,len,insert);
+    else {
+        LTI *next=NULL;
+        insert=insert?INSERT:0; // true/false -> INSERT/0
+        lti=aa_find(&ltv->sub.ltis,name,len,&insert,&next);
+        if (insert && !LTI_invalid(lti)) // freshly inserted
+            ring_link(ltv,lti,next);
+    }
+    lt_unlock(stripe);
  done:
+    if (!finding && !LTI_invalid(lti) && lti_cow(lti))
+        lti=NULL; // couldn't unshare its values
+    if (finding)
+        lti=lti_lazy(ltv,lti);
+    lt_rcu_unlock(locked);
     return LTI_invalid(lti)?NULL:lti;
 }
 
 LTI *LTV_remove(LTV *ltv,char *name,int len)
 {
-    LTI *result=ltv->flags&LT_LIST?NULL:aa_remove(&ltv->sub.ltis,name,len,false);
+    int status=0;
+    LTI *result=NULL;
+    STRY(ltv_shared(ltv),"removing from an ltv shared with a snapshot (see LTV_cow)");
+    LT_STRIPE *stripe=lt_lock(ltv);
+    result=(ltv->flags&LT_LIST)?NULL:ltv->flags&LT_HASH?lth_remove(ltv,name,len):aa_remove(&ltv->sub.ltis,name,len,false);
+    if (!(ltv->flags&(LT_LIST|LT_HASH)) && !LTI_invalid(result))
+        ring_unlink(ltv,result);
+    lt_unlock(stripe);
+ done:
     return result;
 }
 
+// balanced AA tree over n sorted ltis: a subtree of s nodes sits at level floor(log2(s+1)),
+// which puts every left child one level down and makes any right child at the same level a leaf
+static LTI *aa_build(LTI **ltis,int n) {
+    if (!n)
+        return &aa_sentinel;
+    int mid=(n-1)/2;
+    LTI *lti=ltis[mid];
+    lti->lnk[LEFT]=aa_build(ltis,mid);
+    lti->lnk[RIGHT]=aa_build(ltis+mid+1,n-mid-1);
+    lti->level=31-__builtin_clz(n+1);
+    return lti;
+}
+
+int LTV_bulk(LTV *ltv,LT_BULK *pairs,int n,int flags)
+{
+    int status=0,added=0,size=0,merged=0,locked=lt_rcu_lock(); // dest's ltis stay put until the values are in
+    int *order=NULL;
+    LTI **dest=NULL,**ltis=NULL;
+    STRY(!ltv || (ltv->flags&LT_LIST) || n<0 || (n && !pairs),"validating LTV_bulk parameters");
+    STRY(n && ltv_shared(ltv),"inserting into an ltv shared with a snapshot (see LTV_cow)");
+    if (!n)
+        goto done;
+
+    int cmp(const void *a,const void *b) { // by name, then input position, so equal names keep their order
+        LT_BULK *x=&pairs[*(int *) a],*y=&pairs[*(int *) b];
+        int delta=strnncmp(x->name,x->len,y->name,y->len);
+        return delta?delta:*(int *) a-*(int *) b;
+    }
+
+    STRY(!(order=(int *) mymalloc(n*sizeof(int))),"allocating bulk order");
+    STRY(!(dest=(LTI **) mymalloc(n*sizeof(LTI *))),"allocating bulk destinations");
+    for (int i=0;i<n;i++) {
+        order[i]=i;
+        if (pairs[i].len==-1)
+            pairs[i].len=strlen(pairs[i].name);
+    }
+    if (!(flags&LT_BULK_SORTED))
+        qsort(order,n,sizeof(int),cmp);
+
+    LTI *root=ltv->sub.ltis;
+    int est=(ltv->flags&LT_HASH) || LTI_invalid(root)?0:(1<<root->level)-1; // an AA tree holds at least 2^level-1 ltis
+    if ((ltv->flags&(LT_HASH|LT_LAZY)) || n*(32-__builtin_clz(est+n))<est) { // hashed, lazy, or too small a batch to pay for a rebuild
+        for (int i=0;i<n;i++) {
+            LT_BULK *pair=&pairs[order[i]];
+            dest[order[i]]=LTV_find(ltv,pair->name,pair->len,true);
+        }
+    } else { // merge the existing ring with the sorted batch, then rebuild tree and ring in one pass
+        LT_STRIPE *stripe=lt_lock(ltv);
+        LTI *first=ltv->sub.first,*old=first;
+        for (LTI *t=first;t;t=t->thread[FWD]==first?NULL:t->thread[FWD])
+            size++;
+        TRY(!(ltis=(LTI **) mymalloc((size+n)*sizeof(LTI *))),"allocating merge array");
+        for (int i=0;!status && i<n;i++) {
+            LT_BULK *pair=&pairs[order[i]];
+            for (;old && strnncmp(old->name,old->len,pair->name,pair->len)<0;old=old->thread[FWD]==first?NULL:old->thread[FWD])
+                ltis[merged++]=old;
+            if (old && !strnncmp(old->name,old->len,pair->name,pair->len)) { // joins an existing lti
+                ltis[merged++]=dest[order[i]]=old;
+                old=old->thread[FWD]==first?NULL:old->thread[FWD];
+            }
+            else if (merged && !strnncmp(ltis[merged-1]->name,ltis[merged-1]->len,pair->name,pair->len))
+                dest[order[i]]=ltis[merged-1]; // same name as the previous pair
+            else if ((dest[order[i]]=LTI_init(NEW(LTI),pair->name,pair->len)))
+                ltis[merged++]=dest[order[i]];
+        }
+        for (;ltis && old;old=old->thread[FWD]==first?NULL:old->thread[FWD])
+            ltis[merged++]=old;
+        for (int i=0;i<merged;i++) {
+            ltis[i]->thread[FWD]=ltis[(i+1)%merged];
+            ltis[i]->thread[REV]=ltis[(i+merged-1)%merged];
+        }
+        if (merged) {
+            ltv->sub.first=ltis[0];
+            ltv->sub.ltis=aa_build(ltis,merged);
+        }
+        lt_unlock(stripe);
+        SCATCH("merging bulk names");
+        for (int i=0;i<n;i++) // as in LTV_find: joining an lti unshares its snapshot values first
+            if (dest[i] && lti_cow(dest[i]))
+                dest[i]=NULL;
+    }
+
+    for (int i=0;i<n;i++) { // values go in outside the tree lock (LTV_put takes the lti's own)
+        LT_BULK *pair=&pairs[order[i]];
+        LTI *lti=dest[order[i]];
+        if (lti && !((flags&LT_BULK_FIRST) && !CLL_EMPTY(&lti->ltvs)) && LTV_put(&lti->ltvs,pair->ltv,TAIL,NULL))
+            added++;
+        else
+            LTV_release(pair->ltv);
+    }
+
+ done:
+    for (int i=0;status && pairs && i<n;i++) // refused outright; the values are still ours to drop
+        LTV_release(pairs[i].ltv);
+    lt_rcu_unlock(locked);
+    DELETE(order);
+    DELETE(dest);
+    DELETE(ltis);
+    return status?-1:added;
+}
+
 // release old data if present and configure with new data if present
 LTV *LTV_renew(LTV *ltv,void *data,int len,LTV_FLAGS flags)
 {
-    flags|=ltv->flags&LT_META; // need to preserve the original metaflags
-    if (ltv->data && (ltv->flags&LT_FREE) && !(ltv->flags&LT_NAP))
+    flags=(flags&~LT_INL)|(ltv->flags&LT_META); // need to preserve the original metaflags
+    if (ltv->data && (ltv->flags&LT_FREE) && !(ltv->flags&(LT_NAP|LT_INL)))
         RELEASE(ltv->data);
     ltv->len=(len<0 && !(flags&LT_NSTR))?(int) strlen((char *) data):len;
     ltv->data=data;
-    if (flags&LT_DUP) ltv->data=bufdup(ltv->data,ltv->len);
+    if ((flags&LT_DUP) && !(flags&LT_NAP) && ltv->len>=0 && ltv->len<LTV_INLINE) { // short enough to skip the heap
+        memmove(ltv->inl,data,ltv->len); // data may already be inline (renewed in place)
+        ltv->inl[ltv->len]=0;
+        ltv->data=ltv->inl;
+        flags|=LT_INL;
+    }
+    else if (flags&LT_DUP) ltv->data=bufdup(ltv->data,ltv->len);
     if (flags&LT_ESC) strstrip(ltv->data,&ltv->len);
     ltv->flags=flags;
     return ltv;
@@ -226,26 +770,42 @@ LTV *LTV_renew(LTV *ltv,void *data,int len,LTV_FLAGS flags)
 LTV *LTV_init(LTV *ltv,void *data,int len,LTV_FLAGS flags)
 {
     if (ltv && ((flags&LT_NAP) || data)) { // null ptr is error
-        ltv_count++;
+        STAT_ADD(STAT_LTV,1);
         ZERO(*ltv);
-        if (flags&LT_LIST)
+        if (flags&LT_LIST) {
             CLL_init(&ltv->sub.ltvs);
+            if (flags&LT_RING)
+                LTV_ring(&ltv->sub.ltvs);
+        }
+        else if (flags&LT_HASH)
+            ltv->sub.hash=NULL,ltv->sub.first=NULL;
         else
-            ltv->sub.ltis=&aa_sentinel;
+            ltv->sub.ltis=&aa_sentinel,ltv->sub.first=NULL;
         LTV_renew(ltv,data,len,flags);
     }
     TALLOC(ltv,sizeof(LTV),"LTV");
     return ltv;
 }
 
+static void ltv_reclaim(void *ptr)
+{
+    LTV *ltv=(LTV *) ptr;
+    if (lt_imaged(ltv))
+        return;
+    int derived=ltv->flags&LT_TYPE; // embedded in a larger, malloc'ed TYPE_INFO_LTV; not a slab node
+    LTV_renew(ltv,NULL,0,0);
+    if (derived)
+        DELETE(ltv);
+    else
+        RELEASE(ltv);
+    STAT_ADD(STAT_LTV,-1);
+}
+
 void LTV_free(LTV *ltv)
 {
     TDEALLOC(ltv,"LTV");
-    if (ltv) {
-        LTV_renew(ltv,NULL,0,0);
-        RELEASE(ltv);
-        ltv_count--;
-    }
+    if (ltv && !lt_defer(ltv_reclaim,ltv))
+        ltv_reclaim(ltv);
 }
 
 void *LTV_map(LTV *ltv,int dir,LTI_OP lti_op,CLL_OP cll_op)
@@ -253,7 +813,9 @@ void *LTV_map(LTV *ltv,int dir,LTI_OP lti_op,CLL_OP cll_op)
     void *result=NULL;
     if (ltv) {
         if (ltv->flags&LT_LIST && cll_op)
-            result=CLL_map(&ltv->sub.ltvs,dir,cll_op);
+            result=LTV_ringed(&ltv->sub.ltvs)?NULL:CLL_map(&ltv->sub.ltvs,dir,cll_op); // rings have no LTVRs; see LTV_each
+        else if (lti_op && ltv->flags&LT_HASH)
+            result=lth_map(ltv,lti_op,dir);
         else if (lti_op)
             result=aa_map(ltv->sub.ltis,lti_op,dir|INFIX);
     }
@@ -265,26 +827,41 @@ void *LTV_map(LTV *ltv,int dir,LTI_OP lti_op,CLL_OP cll_op)
 LTVR *LTVR_init(LTVR *ltvr,LTV *ltv)
 {
     if (ltvr && ltv) {
-        ltvr_count++;
+        if (!ltv_hold(ltv)) { // lost a race with the last release
+            RELEASE(ltvr);
+            return NULL;
+        }
+        STAT_ADD(STAT_LTVR,1);
         ZERO(*ltvr);
         CLL_init(&ltvr->lnk);
         ltvr->ltv=ltv;
-        ltv->refs++;
     }
     TALLOC(ltvr,sizeof(LTVR),"LTVR");
     return ltvr;
 }
 
+static void ltvr_reclaim(void *ptr)
+{
+    LTVR *ltvr=(LTVR *) ptr;
+    if (lt_imaged(ltvr))
+        return;
+    RELEASE(ltvr);
+    STAT_ADD(STAT_LTVR,-1);
+}
+
 LTV *LTVR_free(LTVR *ltvr)
 {
     LTV *ltv=NULL;
     TDEALLOC(ltvr,"LTVR");
     if (ltvr) {
         if (!CLL_EMPTY(&ltvr->lnk)) { CLL_cut(&ltvr->lnk); }
-        if ((ltv=ltvr->ltv))
-            ltv->refs--;
-        RELEASE(ltvr);
-        ltvr_count--;
+        if ((ltv=ltvr->ltv)) {
+            if (ltvr->cow)
+                ltv_cows(ltv,-1);
+            ltv_drop(ltv);
+        }
+        if (!lt_defer(ltvr_reclaim,ltvr))
+            ltvr_reclaim(ltvr);
     }
     return ltv;
 }
@@ -296,12 +873,12 @@ LTI *LTI_init(LTI *lti,char *name,int len)
     if (lti==NULL)
         lti=NEW(LTI);
     if (lti && name) {
-        lti_count++;
+        STAT_ADD(STAT_LTI,1);
         ZERO(*lti);
         lti->lnk[LEFT]=lti->lnk[RIGHT]=&aa_sentinel;
         lti->level=1;
         lti->len=len;
-        lti->name=bufdup(name,len);
+        lti->name=strintern(name,len);
         for (int i=0;i<PREVIEWLEN;i++)
             lti->preview[i]=len>i?name[i]:0;
         CLL_init(&lti->ltvs);
@@ -310,14 +887,21 @@ LTI *LTI_init(LTI *lti,char *name,int len)
     return lti;
 }
 
+static void lti_reclaim(void *ptr)
+{
+    LTI *lti=(LTI *) ptr;
+    if (lt_imaged(lti)) // name is in the image's pool, not interned
+        return;
+    strunintern(lti->name);
+    RELEASE(lti);
+    STAT_ADD(STAT_LTI,-1);
+}
+
 void LTI_free(LTI *lti)
 {
     TDEALLOC(lti,"LTI");
-    if (lti) {
-        RELEASE(lti->name);
-        RELEASE(lti);
-        lti_count--;
-    }
+    if (lti && !lt_defer(lti_reclaim,lti))
+        lti_reclaim(lti);
 }
 
 
@@ -325,18 +909,182 @@ void LTI_free(LTI *lti)
 // Tag Team of release methods for LT elements
 //////////////////////////////////////////////////
 
+//////////////////////////////////////////////////
+// Deferred reclamation
+// LTV_release just claims a dead LTV and queues it through LTV.dying, so a
+// release never allocates. Subtrees are torn down a
+// bounded number of children at a time (children that die are queued, never
+// recursed into), either by the releasing thread or, once lt_concurrent, by a
+// background reclaimer. Freed nodes still go through lt_defer, so RCU readers
+// that are mid-walk in a dying subtree never see its memory disappear.
+//////////////////////////////////////////////////
+
+#define LT_RECLAIM_BUDGET 256 // children torn down per inline step
+
+static LTV *lt_dying=NULL,*lt_dying_tail=NULL; // claimed (refs==LTV_DYING) LTVs, linked through LTV.dying
+static int lt_dying_busy=0; // dequeued and being torn down
+static pthread_mutex_t lt_dying_mutex=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t lt_dying_cond=PTHREAD_COND_INITIALIZER;
+static pthread_t lt_reclaimer_thread;
+static int lt_reclaimer=0;       // background reclaimer is running
+static int lt_reclaimer_tried=0; // start attempted since lt_concurrent was last set
+static int lt_reclaimer_quit=0;  // asked to exit (see lt_concurrent_restore)
+static __thread int lt_reclaiming=0; // this thread is inside LTV_reclaim
+
+static void lt_dying_lock()   { if (LT_CONCURRENT) pthread_mutex_lock(&lt_dying_mutex); }
+static void lt_dying_unlock() { if (LT_CONCURRENT) pthread_mutex_unlock(&lt_dying_mutex); }
+
+// (re)queue a claimed LTV; a requeue (busy) goes back to the head to be finished first
+static void lt_dying_put(LTV *ltv,int busy) {
+    lt_dying_lock();
+    if (busy)
+        ltv->dying=lt_dying,lt_dying=ltv;
+    else
+        ltv->dying=NULL,*(lt_dying_tail?&lt_dying_tail->dying:&lt_dying)=ltv;
+    if (!ltv->dying)
+        lt_dying_tail=ltv;
+    lt_dying_busy-=busy;
+    if (lt_reclaimer)
+        pthread_cond_signal(&lt_dying_cond);
+    lt_dying_unlock();
+}
+
+static LTV *lt_dying_get() {
+    lt_dying_lock();
+    LTV *ltv=lt_dying;
+    if (ltv && !(lt_dying=ltv->dying))
+        lt_dying_tail=NULL;
+    lt_dying_busy+=ltv!=NULL;
+    lt_dying_unlock();
+    return ltv;
+}
+
+static int ring_teardown(CLL *ltvs,int *budget);
+
+// tear down up to *budget of a claimed LTV's children; true once the LTV itself is freed
+static int ltv_teardown(LTV *ltv,int *budget) {
+    if (ltv->flags&LT_REFS)
+        REF_delete(ltv),(*budget)--; // refs are short, and their roots die through the queue anyway
+    else if (ltv->flags&LT_LIST && LTV_ringed(&ltv->sub.ltvs)) {
+        if (!ring_teardown(&ltv->sub.ltvs,budget))
+            return false;
+    }
+    else if (ltv->flags&LT_LIST) {
+        CLL *lnk=NULL;
+        for (;*budget && (lnk=CLL_get(&ltv->sub.ltvs,POP,HEAD));(*budget)--)
+            LTVR_release(lnk);
+        if (!CLL_EMPTY(&ltv->sub.ltvs))
+            return false;
+    }
+    else if (ltv->flags&LT_HASH) {
+        if (!lth_teardown(ltv,budget))
+            return false;
+    }
+    else {
+        LTI *lti=NULL;
+        for (;*budget && (lti=ltv->sub.first);(*budget)--) { // consume the sorted ring; the dead tree is never searched again
+            ring_unlink(ltv,lti);
+            LTI_release(lti);
+        }
+        if (ltv->sub.first)
+            return false;
+        ltv->sub.ltis=&aa_sentinel;
+    }
+    LTV_free(ltv);
+    return true;
+}
+
+// tear down up to "budget" children (<0: until the queue is empty); returns LTVs still pending
+int LTV_reclaim(int budget)
+{
+    int outer=lt_reclaiming;
+    LTV *ltv=NULL;
+    lt_reclaiming=true;
+    while (budget && (ltv=lt_dying_get())) {
+        if (ltv_teardown(ltv,&budget)) {
+            lt_dying_lock();
+            lt_dying_busy--;
+            lt_dying_unlock();
+        }
+        else
+            lt_dying_put(ltv,true);
+    }
+    lt_reclaiming=outer;
+    lt_dying_lock();
+    int pending=lt_dying_busy+(lt_dying!=NULL);
+    lt_dying_unlock();
+    return pending;
+}
+
+static void *lt_reclaimer_main(void *unused) {
+    for (;;) {
+        pthread_mutex_lock(&lt_dying_mutex);
+        while (!lt_dying && !lt_reclaimer_quit)
+            pthread_cond_wait(&lt_dying_cond,&lt_dying_mutex);
+        int quit=lt_reclaimer_quit;
+        pthread_mutex_unlock(&lt_dying_mutex);
+        if (quit)
+            return NULL;
+        LTV_reclaim(LT_RECLAIM_BUDGET);
+    }
+}
+
+static void lt_reclaimer_start() {
+    pthread_mutex_lock(&lt_dying_mutex);
+    if (!lt_reclaimer_tried) {
+        lt_reclaimer_quit=false;
+        lt_reclaimer=!pthread_create(&lt_reclaimer_thread,NULL,lt_reclaimer_main,NULL);
+        __atomic_store_n(&lt_reclaimer_tried,true,__ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&lt_dying_mutex);
+}
+
+int lt_concurrent_enter(int pin)
+{
+    if (pin)
+        __atomic_store_n(&lt_concurrent_pinned,true,__ATOMIC_RELEASE);
+    return __atomic_exchange_n(&lt_concurrent,true,__ATOMIC_ACQ_REL);
+}
+
+// Leaving concurrent mode is only safe with no other thread alive to be mid-operation on the locked/atomic paths,
+// so it's refused outright once pinned; callers restore only after joining every helper they started.
+void lt_concurrent_restore(int concurrent)
+{
+    if (concurrent || !LT_CONCURRENT || __atomic_load_n(&lt_concurrent_pinned,__ATOMIC_ACQUIRE))
+        return;
+    pthread_mutex_lock(&lt_dying_mutex);
+    int running=lt_reclaimer;
+    lt_reclaimer_quit=true;
+    pthread_cond_signal(&lt_dying_cond);
+    pthread_mutex_unlock(&lt_dying_mutex);
+    if (running) // it finishes its slice first, requeueing anything half torn down
+        pthread_join(lt_reclaimer_thread,NULL);
+    lt_reclaimer=lt_reclaimer_tried=false;
+    while (LTV_reclaim(-1)); // nobody else is tearing down now
+    rcu_barrier(); // deferred frees land before every path goes back to plain loads and stores
+    __atomic_store_n(&lt_concurrent,false,__ATOMIC_RELEASE);
+}
+
 void LTV_release(LTV *ltv)
 {
-    void *op(LTI *lti) { LTI_release(lti); return (void *) NULL; }
     if (ltv) TALLOC(ltv,ltv->refs,"LTV_release (ptr/refs)");
-    if (ltv && !(ltv->refs) && !(ltv->flags&LT_RO)) {
-        if (ltv->flags&LT_REFS)      REF_delete(ltv); // cleans out REFS
-        else if (ltv->flags&LT_LIST) CLL_release(&ltv->sub.ltvs,LTVR_release);
-        else                         aa_map(ltv->sub.ltis,op,POSTFIX);
-        LTV_free(ltv);
+    if (ltv && !(ltv->flags&LT_RO) && ltv_claim(ltv)) {
+        if (LT_CONCURRENT && !__atomic_load_n(&lt_reclaimer_tried,__ATOMIC_ACQUIRE))
+            lt_reclaimer_start();
+        lt_dying_put(ltv,false);
+        if (!lt_reclaiming && !lt_reclaimer) // pay down a bounded slice of the backlog
+            LTV_reclaim(LT_RECLAIM_BUDGET);
     }
 }
 
+// between units of work (VM yields): without a reclaimer thread, nothing else pays down what LTV_release left queued
+int LTV_idle()
+{
+    if (lt_reclaimer || lt_reclaiming || !lt_dying) // an unlocked peek; a miss just waits for the next idle
+        return 0;
+    return LTV_reclaim(LT_RECLAIM_BUDGET);
+}
+
 void LTVR_release(CLL *lnk) { LTV_release(LTVR_free((LTVR *) lnk)); }
 
 void LTI_release(LTI *lti) {
@@ -351,72 +1099,176 @@ void LTI_release(LTI *lti) {
 // Tag Team of traverse methods for LT elements
 //////////////////////////////////////////////////
 
+static unsigned lt_epochs=0;         // last epoch handed out
+static __thread unsigned lt_epoch=0; // epoch of this thread's innermost traversal
+
 // add to preop to avoid repeat visits in listree traverse
 void *listree_acyclic(LTI **lti,LTVR *ltvr,LTV **ltv,int depth,LT_TRAVERSE_FLAGS *flags) {
-    if ((*flags&LT_TRAVERSE_LTV) && (*ltv)->flags&(LT_AVIS|LT_RVIS))
+    if ((*flags&LT_TRAVERSE_LTV) && ((*ltv)->avis==lt_epoch || (*ltv)->flags&LT_RVIS))
         *flags|=LT_TRAVERSE_HALT;
     return (*flags)&LT_TRAVERSE_HALT?NON_NULL:NULL;
 }
 
-void *listree_traverse(CLL *ltvs,LTOBJ_OP preop,LTOBJ_OP postop)
-{
-    int depth=0,cleanup=0;
+// One frame per LTV or LTI currently being descended; replaces the recursion.
+typedef struct {
+    LTV *ltv;      // LTV frame: the LTV; LTI frame: its parent LTV
+    LTI *lti;      // LTV frame: parent LTI (as handed to pre/postop); LTI frame: the LTI
+    LTVR *ltvr;    // LTV frame: parent LTVR
+    LTI *child;    // LTV frame: LTI returned by preop; if it isn't "lti", descend only into it
+    CLL *sentinel; // CLL being walked (lti->ltvs or a list-form ltv's sub.ltvs); NULL when walking LTIs
+    void *next;    // cursor, saved before descending so ops can cut the current item
+    int pos;       // cursor within a ring-form sentinel (next is then just non-NULL)
+    LT_TRAVERSE_FLAGS flags;
+    int dir;
+} LT_FRAME;
+
+#define LT_FRAMES 32 // frames on the C stack before spilling to the heap
+
+typedef struct {
+    LTOBJ_OP preop,postop;
+    LT_FRAME *frame,local[LT_FRAMES];
+    int top,size,depth;
+    unsigned epoch;
+} LT_TRAVERSAL;
+
+static LT_FRAME *traverse_push(LT_TRAVERSAL *t) {
+    if (t->top==t->size) {
+        int size=t->size*2;
+        LT_FRAME *frame=(LT_FRAME *) (t->frame==t->local?mymalloc(size*sizeof(LT_FRAME)):myrealloc(t->frame,size*sizeof(LT_FRAME)));
+        if (!frame)
+            return NULL;
+        if (t->frame==t->local)
+            memcpy(frame,t->local,sizeof(t->local));
+        t->frame=frame;
+        t->size=size;
+    }
+    return &ZERO(t->frame[t->top++]);
+}
+
+static void *traverse_ltv(LT_TRAVERSAL *t,LTI *parent_lti,LTVR *parent_ltvr,LTV *ltv) {
     void *rval=NULL;
+    LTI *child=parent_lti;
+    LT_TRAVERSE_FLAGS flags=LT_TRAVERSE_LTV;
+    LT_FRAME *f=NULL;
+    if (!ltv)
+        return NULL;
+    if ((t->preop && (rval=t->preop(&child,parent_ltvr,&ltv,t->depth,&flags))) || (flags&LT_TRAVERSE_HALT) || (ltv->flags&LT_REFS)) {
+        ltv->avis=t->epoch;
+        return rval;
+    }
+    if (!(f=traverse_push(t))) {
+        ltv->avis=t->epoch;
+        return NON_NULL;
+    }
+    ltv->flags|=LT_RVIS;
+    t->depth++;
+    f->ltv=ltv;
+    f->lti=parent_lti;
+    f->ltvr=parent_ltvr;
+    f->child=child;
+    f->flags=flags;
+    f->dir=(flags&LT_TRAVERSE_REVERSE)?REV:FWD;
+    if (child!=parent_lti)
+        f->next=child;
+    else if (ltv->flags&LT_LIST && LTV_ringed(&ltv->sub.ltvs))
+        f->next=LTV_len(f->sentinel=&ltv->sub.ltvs)?f->sentinel:NULL;
+    else if (ltv->flags&LT_LIST)
+        f->next=CLL_next(f->sentinel=&ltv->sub.ltvs,NULL,f->dir);
+    else
+        f->next=f->dir==REV?LTI_last(ltv):LTI_first(ltv);
+    return NULL;
+}
 
-    void *descend_ltv(LTI *parent_lti,LTVR *parent_ltvr,LTV *ltv) {
-        void *descend_lti(LTI *lti) {
-            void *descend_ltvr(CLL *lnk) { // for normal-form (ltv->lti->ltvr) form ltv
-                LTVR *ltvr=(LTVR *) lnk;
-                return descend_ltv(lti,ltvr,ltvr->ltv);
-            }
+static void *traverse_lti(LT_TRAVERSAL *t,LTV *ltv,LTI *lti) {
+    void *rval=NULL;
+    LT_TRAVERSE_FLAGS flags=LT_TRAVERSE_LTI;
+    LT_FRAME *f=NULL;
+    if (!lti)
+        return NULL;
+    if (t->preop && (rval=t->preop(&lti,NULL,&ltv,t->depth,&flags)))
+        return rval;
+    if (flags&LT_TRAVERSE_HALT)
+        return NULL;
+    if (!(f=traverse_push(t)))
+        return NON_NULL;
+    f->ltv=ltv;
+    f->lti=lti;
+    f->flags=flags;
+    f->dir=(flags&LT_TRAVERSE_REVERSE)?REV:FWD;
+    f->next=CLL_next(f->sentinel=&lti->ltvs,NULL,f->dir);
+    return NULL;
+}
 
-            if (!lti) goto done;
-            LTV *parent=ltv;
-            LT_TRAVERSE_FLAGS flags=LT_TRAVERSE_LTI;
-            if (cleanup) CLL_map(&lti->ltvs,FWD,descend_ltvr);
-            else if (preop && (rval=preop(&lti,NULL,&parent,depth,&flags)) ||
-                     ((flags&LT_TRAVERSE_HALT) || (rval=CLL_map(&lti->ltvs,(flags&LT_TRAVERSE_REVERSE)?REV:FWD,descend_ltvr))) ||
-                     postop && ((flags|=LT_TRAVERSE_POST),(rval=postop(&lti,NULL,&parent,depth,&flags))))
-                goto done;
-        done:
-            return rval;
-        }
+static void *traverse_pop(LT_TRAVERSAL *t) {
+    void *rval=NULL;
+    LT_FRAME *f=&t->frame[--t->top];
+    f->flags|=LT_TRAVERSE_POST;
+    if (f->flags&LT_TRAVERSE_LTI)
+        rval=t->postop?t->postop(&f->lti,NULL,&f->ltv,t->depth,&f->flags):NULL;
+    else {
+        t->depth--;
+        f->ltv->flags&=~LT_RVIS;
+        rval=t->postop?t->postop(&f->lti,f->ltvr,&f->ltv,t->depth,&f->flags):NULL;
+        f->ltv->avis=t->epoch;
+    }
+    return rval;
+}
 
-        void *descend_ltvr(CLL *lnk) { // for list-form ltv
-            LTVR *ltvr=(LTVR *) lnk;
-            return descend_ltv(NULL,ltvr,ltvr->ltv); // LTI is null in this case
+// early exit: skip remaining postops, but leave LTVs marked and off the recursion path
+static void traverse_unwind(LT_TRAVERSAL *t) {
+    while (t->top) {
+        LT_FRAME *f=&t->frame[--t->top];
+        if (f->flags&LT_TRAVERSE_LTV) {
+            t->depth--;
+            f->ltv->flags&=~LT_RVIS;
+            f->ltv->avis=t->epoch;
         }
+    }
+}
 
-        if (!ltv) goto done;
-        LTI *child=parent_lti;
-        LT_TRAVERSE_FLAGS flags=LT_TRAVERSE_LTV;
-        if (cleanup) // only descends (and cleans up) LTVs w/absolute visited flag
-            return (ltv->flags&LT_AVIS && !((ltv->flags&=~LT_AVIS)&LT_AVIS) && !(ltv->flags&LT_REFS))? LTV_map(ltv,FWD,descend_lti,descend_ltvr):NULL;
-        else {
-            if (preop && (rval=preop(&child,parent_ltvr,&ltv,depth,&flags))) goto done;
-            if ((flags&LT_TRAVERSE_HALT) || (ltv->flags&LT_REFS)) goto done;
-            ltv->flags|=LT_RVIS;
-            depth++;
-            rval=(child!=parent_lti)?descend_lti(child):LTV_map(ltv,(flags&LT_TRAVERSE_REVERSE)?REV:FWD,descend_lti,descend_ltvr);
-            depth--;
-            ltv->flags&=~LT_RVIS;
-            if (rval) goto done;
-
-            flags|=LT_TRAVERSE_POST;
-            if (postop && ((rval=postop(&parent_lti,parent_ltvr,&ltv,depth,&flags)))) goto done;
-        }
+void *listree_traverse(CLL *ltvs,LTOBJ_OP preop,LTOBJ_OP postop)
+{
+    void *rval=NULL;
+    LT_TRAVERSAL t;
+    unsigned outer=lt_epoch;
 
-    done:
-        if (ltv) ltv->flags|=LT_AVIS;
-        return rval;
-    }
+    t.preop=preop;
+    t.postop=postop;
+    t.frame=t.local;
+    t.top=t.depth=0;
+    t.size=LT_FRAMES;
+    do t.epoch=__sync_add_and_fetch(&lt_epochs,1); while (!t.epoch); // 0 is "never visited"
+    lt_epoch=t.epoch;
 
     TSTART(0,"listree_traverse");
-    void *traverse(CLL *lnk) { LTVR *ltvr=(LTVR *) lnk; return descend_ltv(NULL,ltvr,ltvr->ltv); }
-    rval=CLL_map(ltvs,FWD,traverse);
-    cleanup=1;
-    preop=postop=NULL;
-    CLL_map(ltvs,FWD,traverse); // clean up "visited" flags
+    for (CLL *lnk=CLL_next(ltvs,NULL,FWD),*next=NULL; lnk && !rval; lnk=next) {
+        next=CLL_next(ltvs,lnk,FWD);
+        rval=traverse_ltv(&t,NULL,(LTVR *) lnk,((LTVR *) lnk)->ltv);
+        while (t.top && !rval) {
+            LT_FRAME *f=&t.frame[t.top-1]; // not valid past a push
+            if (!f->next)
+                rval=traverse_pop(&t);
+            else if (f->sentinel && LTV_ringed(f->sentinel)) {
+                LTV *child=LTV_at(f->sentinel,f->pos++,f->dir);
+                if (!child)
+                    f->next=NULL;
+                else
+                    rval=traverse_ltv(&t,NULL,NULL,child);
+            } else if (f->sentinel) {
+                LTVR *ltvr=(LTVR *) f->next;
+                f->next=CLL_next(f->sentinel,f->next,f->dir);
+                rval=traverse_ltv(&t,(f->flags&LT_TRAVERSE_LTI)?f->lti:NULL,ltvr,ltvr->ltv);
+            } else {
+                LTI *lti=(LTI *) f->next;
+                f->next=(f->child!=f->lti)?NULL:LTI_iter(f->ltv,lti,f->dir);
+                rval=traverse_lti(&t,f->ltv,lti);
+            }
+        }
+        traverse_unwind(&t);
+    }
+    if (t.frame!=t.local)
+        DELETE(t.frame);
+    lt_epoch=outer;
     TFINISH(rval!=0,"listree_traverse");
     return rval;
 }
@@ -435,16 +1287,69 @@ void *ltv_traverse(LTV *ltv,LTOBJ_OP preop,LTOBJ_OP postop)
 // Basic LT insert/remove
 //////////////////////////////////////////////////
 
-extern LTI *LTI_first(LTV *ltv) { return (!ltv || (ltv->flags&LT_LIST))?NULL:aa_most(ltv->sub.ltis,LEFT);  }
-extern LTI *LTI_last(LTV *ltv)  { return (!ltv || (ltv->flags&LT_LIST))?NULL:aa_most(ltv->sub.ltis,RIGHT); }
-extern LTI *LTI_iter(LTV *ltv,LTI *lti,int dir) { dir|=ITER; return ltv&&!LTI_invalid(lti)? aa_find(&ltv->sub.ltis,lti->name,lti->len,&dir):NULL; }
+extern LTI *LTI_first(LTV *ltv) { return (!ltv || (ltv->flags&LT_LIST) || !lth_order(ltv))?NULL:ltv->sub.first; }
+extern LTI *LTI_last(LTV *ltv)  { LTI *first=LTI_first(ltv); return first?first->thread[REV]:NULL; }
+extern LTI *LTI_iter(LTV *ltv,LTI *lti,int dir) {
+    if (!ltv || LTI_invalid(lti) || !lth_order(ltv)) return NULL;
+    if (!lti->thread[FWD]) { // unlinked meanwhile (its name outlives it under RCU); pick up where that name sorts
+        LTI *next=LTI_seek(ltv,lti->name,lti->len);
+        return (dir&1)?(LTI_invalid(next)?LTI_last(ltv):next==ltv->sub.first?NULL:next->thread[REV]):next;
+    }
+    LTI *next=lti->thread[dir&1];
+    return (dir&1)?(lti==ltv->sub.first?NULL:next):(next==ltv->sub.first?NULL:next);
+}
+
+LTI *LTI_seek(LTV *ltv,char *name,int len)
+{
+    LTI *lti=NULL;
+    if (!ltv || (ltv->flags&LT_LIST))
+        return NULL;
+    if (ltv->flags&LT_HASH) { // the sorted index is a lazily built cache, so seeks lock
+        LT_STRIPE *stripe=lt_lock(ltv);
+        LTI **sorted=lth_index(ltv);
+        unsigned lo=0,hi=sorted?ltv->sub.hash->count:0;
+        while (lo<hi) {
+            unsigned mid=(lo+hi)/2;
+            if (strnncmp(sorted[mid]->name,sorted[mid]->len,name,len)<0)
+                lo=mid+1;
+            else
+                hi=mid;
+        }
+        lti=sorted && lo<ltv->sub.hash->count?sorted[lo]:NULL;
+        lt_unlock(stripe);
+    }
+    else {
+        LT_STRIPE *stripe=lt_lock(ltv); // rotations rewrite links in place
+        for (LTI *t=ltv->sub.ltis; !LTI_invalid(t); ) // lower bound
+            if (strnncmp(t->name,t->len,name,len)>=0)
+                lti=t,t=t->lnk[LEFT];
+            else
+                t=t->lnk[RIGHT];
+        lt_unlock(stripe);
+    }
+    return lti;
+}
+
+LTI *LTI_glob(LTV *ltv,GLOB *glob,LTI *from)
+{
+    LTI *lti=from?from:LTI_seek(ltv,glob->pat,glob->prefix);
+    for (; !LTI_invalid(lti); lti=LTI_iter(ltv,lti,FWD)) {
+        if (lti->len<glob->prefix || memcmp(lti->name,glob->pat,glob->prefix))
+            return NULL; // sorted past the prefix range
+        if (!glob_match(glob,lti->name,lti->len))
+            return lti;
+    }
+    return NULL;
+}
 
 LTI *LTI_lookup(LTV *ltv,LTV *name,int insert)
 {
     LTI *lti=NULL;
     TLOOKUP(ltv,name->data,name->len,insert);
-    if (LTV_wildcard(name))
-        for (lti=LTI_first(ltv); !LTI_invalid(lti) && fnmatch_len(name->data,name->len,lti->name,-1); lti=LTI_iter(ltv,lti,FWD));
+    if (LTV_wildcard(name)) {
+        GLOB glob;
+        lti=LTI_glob(ltv,glob_compile(&glob,name->data,name->len),NULL);
+    }
     else
         lti=LTV_find(ltv,name->data,name->len,insert);
  done:
@@ -462,10 +1367,182 @@ LTI *LTI_find(LTV *ltv,char *name,int insert,int flags)
 LTI *LTI_resolve(LTV *ltv,char *name,int insert) { return LTV_find(ltv,name,-1,insert); }
 
 
+//////////////////////////////////////////////////
+// Ring-buffer lists (LT_RING): the list's CLL handle holds a tagged pointer to contiguous
+// storage instead of linking LTVRs; O(1) push/pop at either end, length and indexing.
+//////////////////////////////////////////////////
+
+typedef struct {
+    unsigned head;  // slot of the HEAD end
+    unsigned count;
+    unsigned mask;  // capacity-1; capacity is a power of 2
+    LTV *slot[];
+} LT_RINGBUF;
+
+#define RING_TAG ((uintptr_t) 1) // CLL links are aligned, so a set low bit can't be a real link
+#define RING_MIN 8
+#define RING_SLOT(ring,i,end) (((end)?(ring)->head+(ring)->count-1-(i):(ring)->head+(i))&(ring)->mask)
+
+int LTV_ringed(CLL *ltvs) { return ltvs && ((uintptr_t) ltvs->lnk[HEAD])&RING_TAG; }
+static LT_RINGBUF *ring_buf(CLL *ltvs) { return (LT_RINGBUF *) ((uintptr_t) ltvs->lnk[HEAD]&~RING_TAG); }
+static void ring_set(CLL *ltvs,LT_RINGBUF *ring) { ltvs->lnk[HEAD]=(CLL *) ((uintptr_t) ring|RING_TAG); ltvs->lnk[TAIL]=NULL; }
+
+CLL *LTV_ring(CLL *ltvs)
+{
+    if (!ltvs || (!LTV_ringed(ltvs) && !CLL_EMPTY(ltvs)))
+        return NULL;
+    if (!LTV_ringed(ltvs))
+        ring_set(ltvs,NULL); // storage arrives with the first put
+    return ltvs;
+}
+
+static int ring_grow(CLL *ltvs)
+{
+    LT_RINGBUF *ring=ring_buf(ltvs),*bigger=NULL;
+    unsigned size=ring?(ring->mask+1)*2:RING_MIN;
+    if (!(bigger=(LT_RINGBUF *) mymalloc(sizeof(LT_RINGBUF)+size*sizeof(LTV *))))
+        return false;
+    bigger->head=0;
+    bigger->mask=size-1;
+    bigger->count=ring?ring->count:0;
+    for (unsigned i=0;i<bigger->count;i++) // unwrap, HEAD first
+        bigger->slot[i]=ring->slot[RING_SLOT(ring,i,HEAD)];
+    ring_set(ltvs,bigger);
+    DELETE(ring);
+    return true;
+}
+
+static LTV *ring_put(CLL *ltvs,LTV *ltv,int end)
+{
+    LTV *rval=NULL;
+    if (!ltv || !ltv_hold(ltv))
+        return NULL;
+    LT_STRIPE *stripe=lt_lock(ltvs); // also keeps readers off a buffer that's being regrown
+    LT_RINGBUF *ring=ring_buf(ltvs);
+    if ((ring && ring->count<=ring->mask) || ring_grow(ltvs)) {
+        ring=ring_buf(ltvs);
+        if (end)
+            ring->slot[(ring->head+ring->count)&ring->mask]=ltv;
+        else
+            ring->slot[ring->head=(ring->head-1)&ring->mask]=ltv;
+        ring->count++;
+        rval=ltv;
+    }
+    lt_unlock(stripe);
+    if (!rval)
+        ltv_drop(ltv);
+    return rval;
+}
+
+// remove the i'th ltv from HEAD, closing the gap from whichever side is shorter
+static LTV *ring_cut(LT_RINGBUF *ring,unsigned i)
+{
+    LTV *ltv=ring->slot[RING_SLOT(ring,i,HEAD)];
+    if (i<ring->count/2) {
+        for (;i;i--)
+            ring->slot[RING_SLOT(ring,i,HEAD)]=ring->slot[RING_SLOT(ring,i-1,HEAD)];
+        ring->head=(ring->head+1)&ring->mask;
+    } else
+        for (;i+1<ring->count;i++)
+            ring->slot[RING_SLOT(ring,i,HEAD)]=ring->slot[RING_SLOT(ring,i+1,HEAD)];
+    ring->count--;
+    return ltv;
+}
+
+static LTV *ring_get(CLL *ltvs,int pop,int dir,LTV *match)
+{
+    LTV *ltv=NULL;
+    LT_STRIPE *stripe=lt_lock(ltvs);
+    LT_RINGBUF *ring=ring_buf(ltvs);
+    for (unsigned i=0;ring && !ltv && i<ring->count;i++) {
+        LTV *candidate=ring->slot[RING_SLOT(ring,i,dir)];
+        if (match && (candidate->flags&LT_NAP || fnmatch_len(candidate->data,candidate->len,match->data,match->len)))
+            continue;
+        ltv=pop?ring_cut(ring,dir?ring->count-1-i:i):candidate;
+    }
+    lt_unlock(stripe);
+    if (ltv && pop)
+        ltv_drop(ltv);
+    return ltv;
+}
+
+// release up to *budget of a dying list's ltvs, then its storage; true once empty
+static int ring_teardown(CLL *ltvs,int *budget)
+{
+    LT_RINGBUF *ring=ring_buf(ltvs);
+    for (;ring && ring->count && *budget;(*budget)--) {
+        LTV *ltv=ring_cut(ring,0);
+        ltv_drop(ltv);
+        LTV_release(ltv);
+    }
+    if (ring && ring->count)
+        return false;
+    DELETE(ring);
+    ring_set(ltvs,NULL);
+    return true;
+}
+
+int LTV_len(CLL *ltvs)
+{
+    if (!LTV_ringed(ltvs))
+        return CLL_len(ltvs);
+    LT_STRIPE *stripe=lt_lock(ltvs);
+    LT_RINGBUF *ring=ring_buf(ltvs);
+    int len=ring?ring->count:0;
+    lt_unlock(stripe);
+    return len;
+}
+
+LTV *LTV_at(CLL *ltvs,int index,int end)
+{
+    LTV *ltv=NULL;
+    if (!ltvs || index<0)
+        return NULL;
+    if (LTV_ringed(ltvs)) {
+        LT_STRIPE *stripe=lt_lock(ltvs);
+        LT_RINGBUF *ring=ring_buf(ltvs);
+        if (ring && index<ring->count)
+            ltv=ring->slot[RING_SLOT(ring,index,end)];
+        lt_unlock(stripe);
+    } else {
+        CLL *lnk=NULL;
+        for (lnk=CLL_next(ltvs,NULL,end);lnk && index--;lnk=CLL_next(ltvs,lnk,end));
+        ltv=lnk?((LTVR *) lnk)->ltv:NULL;
+    }
+    return ltv;
+}
+
+void *LTV_each(CLL *ltvs,int dir,LTV_OP op)
+{
+    void *rval=NULL;
+    if (LTV_ringed(ltvs)) {
+        LTV *ltv=NULL;
+        for (int i=0;!rval && (ltv=LTV_at(ltvs,i,dir));i++) // by position; op may push or pop elsewhere
+            rval=op(ltv);
+    } else {
+        void *ltvr_op(CLL *lnk) { return op(((LTVR *) lnk)->ltv); }
+        rval=CLL_map(ltvs,dir,ltvr_op);
+    }
+    return rval;
+}
+
+CLL *LTV_merge(CLL *dst,CLL *src,int end)
+{
+    if (!dst || !src)
+        return NULL;
+    if (!LTV_ringed(dst) && !LTV_ringed(src))
+        return CLL_MERGE(dst,src,end),dst;
+    for (LTV *ltv=NULL;(ltv=LTV_deq(src,!end));) // feed from the far end so src keeps its order
+        if (!LTV_enq(dst,ltv,end))
+            LTV_release(ltv);
+    return dst;
+}
+
 int LTV_empty(LTV *ltv)
 {
     if (!ltv) return true;
-    else if (ltv->flags&LT_LIST) return CLL_EMPTY(&ltv->sub.ltvs);
+    else if (ltv->flags&LT_LIST) return LTV_ringed(&ltv->sub.ltvs)?!LTV_len(&ltv->sub.ltvs):CLL_EMPTY(&ltv->sub.ltvs);
+    else if (ltv->flags&LT_HASH) return !ltv->sub.hash || !ltv->sub.hash->count;
     else return LTI_invalid(ltv->sub.ltis);
 }
 
@@ -473,8 +1550,15 @@ LTV *LTV_put(CLL *ltvs,LTV *ltv,int end,LTVR **ltvr_ret)
 {
     int status=0;
     LTVR *ltvr=NULL;
+    if (ltvs && LTV_ringed(ltvs)) {
+        if (ltvr_ret) *ltvr_ret=NULL;
+        return ring_put(ltvs,ltv,end);
+    }
     if (ltv && ltvs && (ltvr=LTVR_init(NEW(LTVR),ltv))) {
-        if (CLL_put(ltvs,&ltvr->lnk,end)) {
+        LT_STRIPE *stripe=lt_lock(ltvs);
+        CLL *put=CLL_put(ltvs,&ltvr->lnk,end);
+        lt_unlock(stripe);
+        if (put) {
             if (ltvr_ret) *ltvr_ret=ltvr;
             return ltv; //!!
         }
@@ -493,17 +1577,24 @@ LTV *LTV_get(CLL *ltvs,int pop,int dir,LTV *match,LTVR **ltvr_ret)
 
     LTVR *ltvr=NULL;
     LTV *ltv=NULL;
+    if (ltvs && LTV_ringed(ltvs)) {
+        if (ltvr_ret) *ltvr_ret=NULL;
+        return ring_get(ltvs,pop,dir,match);
+    }
+    LT_STRIPE *stripe=(pop || match)?lt_lock(ltvs):NULL; // a matching walk can't survive a concurrent cut
     if (!(ltvr=(LTVR *) match?
           CLL_mapfrom(ltvs,((ltvr_ret && (*ltvr_ret))?&(*ltvr_ret)->lnk:NULL),dir,ltv_match):
           CLL_next(ltvs,(ltvr_ret && (*ltvr_ret))?&(*ltvr_ret)->lnk:NULL,dir)))
         goto done;
     ltv=ltvr->ltv;
-    if (pop) {
+    if (pop)
         CLL_cut(&ltvr->lnk);
+ done:
+    lt_unlock(stripe);
+    if (ltv && pop) {
         LTVR_free(ltvr);
         ltvr=NULL;
     }
- done:
     if (ltvr_ret) (*ltvr_ret)=ltvr;
     return ltv;
 }
@@ -523,63 +1614,110 @@ LTV *LTV_dup(LTV *ltv)
 
 LTV *LTV_copy(LTV *ltv,int maxdepth)
 {
-    LTV *index=LTV_NULL,*dupes=LTV_NULL;
-    char buf[32];
-    int index_ltv(LTV *ltv) {
-        LTV *dup=NULL;
-        sprintf(buf,"%p",ltv);
-        if (!LT_get(index,buf,HEAD,KEEP)) {
-            LT_put(index,buf,HEAD,ltv);
-            if (!(ltv->flags&(LT_CVAR|LT_REFS)))
-                dup=LTV_dup(ltv);
-            if (dup)
-                LT_put(dupes,buf,HEAD,LTV_dup(ltv));
-        }
-    }
+    int status=0;
+    LTV *result=NULL;
+    PTRMAP dupes; // original->copy; cvars and refs map to themselves (shared, not copied)
 
     void *index_ltvs(LTI **lti,LTVR *ltvr,LTV **ltv,int depth,LT_TRAVERSE_FLAGS *flags) {
         listree_acyclic(lti,ltvr,ltv,depth,flags);
         if (!((*flags)&LT_TRAVERSE_HALT) && ((*flags)&LT_TRAVERSE_LTV) && depth<=maxdepth) {
-            index_ltv(*ltv);
-            if ((*ltv)->flags&(LT_CVAR|LT_REFS))
+            int shared=(*ltv)->flags&(LT_CVAR|LT_REFS);
+            if (!ptrmap_get(&dupes,*ltv) && !ptrmap_put(&dupes,*ltv,shared?*ltv:LTV_dup(*ltv)))
+                return NON_NULL;
+            if (shared)
                 (*flags)|=LT_TRAVERSE_HALT;
         }
         if (depth==maxdepth)
             (*flags)|=LT_TRAVERSE_HALT;
         return (void *) NULL;
     }
-    ltv_traverse(ltv,index_ltvs,NULL)!=NULL,LTV_NULL;
 
-    LTV *new_or_used(LTV *ltv) {
-        char buf[32];
-        sprintf(buf,"%p",ltv);
-        LTV *rval=NULL;
-        return ((rval=LT_get(dupes,buf,HEAD,KEEP)))?rval:ltv;
+    LTV *new_or_used(LTV *orig) { LTV *dup=ptrmap_get(&dupes,orig); return dup?dup:orig; }
+
+    void *copy_children(void *orig,void *dup) {
+        if (dup!=orig)
+            for (LTI *lti=LTI_first(orig);lti;lti=LTI_iter(orig,lti,FWD))
+                for (LTVR *ltvr=(LTVR *) CLL_next(&lti->ltvs,NULL,FWD);ltvr;ltvr=(LTVR *) CLL_next(&lti->ltvs,&ltvr->lnk,FWD))
+                    LT_put(dup,lti->name,TAIL,new_or_used(ltvr->ltv));
+        return NULL;
     }
 
-    void *descend_lti(LTI *lti) {
-        LTV *orig=LTV_peek(&lti->ltvs,HEAD);
-        LTV *dupe=LT_get(dupes,lti->name,HEAD,KEEP);
+    void *release_orphans(void *orig,void *dup) { // copies never linked in (e.g. only reachable thru a list)
+        if (dup!=orig && dup!=result && !((LTV *) dup)->refs)
+            LTV_release(dup);
+        return NULL;
+    }
 
-        void *copy_children(LTI **lti,LTVR *ltvr,LTV **ltv,int depth,LT_TRAVERSE_FLAGS *flags) {
-            if (((*flags)&LT_TRAVERSE_LTV) && depth==1 && (*lti)) {
-                LT_put(dupe,(*lti)->name,TAIL,new_or_used(*ltv));
-                (*flags)|=LT_TRAVERSE_HALT;
-            }
-            return (void *) NULL;
-        }
+    STRY(!ptrmap_init(&dupes,0),"initializing copy map");
+    STRY(ltv_traverse(ltv,index_ltvs,NULL)!=NULL,"indexing ltvs to copy");
+    ptrmap_map(&dupes,copy_children);
+    result=new_or_used(ltv);
 
-        ltv_traverse(orig,copy_children,NULL)!=NULL,LTV_NULL;
-    done:
-        return (void *) NULL;
+ done:
+    ptrmap_map(&dupes,release_orphans);
+    ptrmap_free(&dupes);
+    return result;
+}
+
+// O(width) snapshot: a new ltv whose children are the original's children, shared
+// until either side mutates them (see LTV_cow); ltv and its snapshot are independent.
+LTV *LTV_snapshot(LTV *ltv)
+{
+    int status=0;
+    LTV *snap=NULL;
+    STRY(!ltv || (ltv->flags&(LT_CVAR|LT_REFS)),"validating snapshot source");
+
+    int flags=(ltv->flags&~(LT_NDUP|LT_RO))|(ltv->flags&(LT_LIST|LT_RING));
+    if (!(flags&LT_NAP))
+        flags|=LT_DUP;
+    STRY(!(snap=LTV_init(NEW(LTV),ltv->data,ltv->len,flags)),"allocating snapshot");
+
+    void cow(LTVR *ltvr) { // count a link into the child's snapshot links
+        if (ltvr && !ltvr->cow && !(ltvr->ltv->flags&(LT_CVAR|LT_REFS))) // cvars/refs are shared outright, as in LTV_copy
+            ltvr->cow=true,ltv_cows(ltvr->ltv,1);
+    }
+
+    void share(CLL *dst,LTVR *ltvr) {
+        LTVR *link=NULL;
+        cow(ltvr);
+        LTV_put(dst,ltvr->ltv,TAIL,&link);
+        cow(link);
     }
-    LTV_map(index,FWD,descend_lti,NULL);
 
-    LTV *result=new_or_used(ltv);
-    LTV_release(index);
-    LTV_release(dupes);
+    void *share_ringed(LTV *child) { LTV_enq(&snap->sub.ltvs,child,TAIL); return NULL; }
+
+    if ((ltv->flags&LT_LIST) && LTV_ringed(&ltv->sub.ltvs))
+        LTV_each(&ltv->sub.ltvs,FWD,share_ringed); // no LTVRs to mark
+    else if (ltv->flags&LT_LIST)
+        for (LTVR *ltvr=(LTVR *) CLL_next(&ltv->sub.ltvs,NULL,FWD);ltvr;ltvr=(LTVR *) CLL_next(&ltv->sub.ltvs,&ltvr->lnk,FWD))
+            share(&snap->sub.ltvs,ltvr);
+    else
+        for (LTI *lti=LTI_first(ltv);lti;lti=LTI_iter(ltv,lti,FWD)) {
+            LTI *dst=LTI_resolve(snap,lti->name,true);
+            for (LTVR *ltvr=(LTVR *) CLL_next(&lti->ltvs,NULL,FWD);dst && ltvr;ltvr=(LTVR *) CLL_next(&lti->ltvs,&ltvr->lnk,FWD))
+                share(&dst->ltvs,ltvr);
+        }
  done:
-    return result;
+    return snap;
+}
+
+// before mutating through ltvr, make sure its ltv isn't shared with a snapshot
+LTV *LTV_cow(LTVR *ltvr)
+{
+    LTV *ltv=ltvr?ltvr->ltv:NULL,*clone=NULL;
+    if (!ltv || !ltvr->cow)
+        return ltv;
+    if (ltv_shared(ltv)) {
+        if (!(clone=LTV_snapshot(ltv)))
+            return NULL;
+        ltv_hold(clone);
+        ltvr->ltv=clone; // repoint ltvr at the clone, dropping its hold on the shared original
+    }
+    ltvr->cow=false; // either way, no longer a snapshot link
+    ltv_cows(ltv,-1);
+    if (clone && !ltv_drop(ltv)) // snapshot let go meanwhile
+        LTV_release(ltv);
+    return ltvr->ltv;
 }
 
 LTV *LTV_concat(LTV *a,LTV *b)
@@ -629,6 +1767,8 @@ void print_ltvs(FILE *ofile,char *pre,CLL *ltvs,char *post,int maxdepth)
                 if      ((*ltv)->flags&LT_REFS) { REF_printall(ofile,(*ltv),"REFS:\n"); fstrnprint(ofile,(*ltv)->data,(*ltv)->len); }
                 else if ((*ltv)->flags&LT_BC)   disassemble(ofile,(*ltv));
                 else if ((*ltv)->flags&LT_CVAR) cif_print_cvar(ofile,(*ltv),depth);
+                else if ((*ltv)->flags&LT_I64)  fprintf(ofile,"%lld",LTV_INT(*ltv));
+                else if ((*ltv)->flags&LT_F64)  fprintf(ofile,"%g",LTV_DBL(*ltv));
                 else if ((*ltv)->flags&LT_IMM)  fprintf(ofile,"IMM 0x%x",(*ltv)->data);
                 else if ((*ltv)->flags&LT_NULL) fprintf(ofile,"<null>");
                 else if ((*ltv)->flags&LT_BIN)  hexdump(ofile,(*ltv)->data,(*ltv)->len);
@@ -709,7 +1849,7 @@ void ltvs2dot(FILE *ofile,CLL *ltvs,int maxdepth,char *label) {
                 for (LTI *lti=LTI_first(ltv);!LTI_invalid(lti);lti=LTI_iter(ltv,lti,FWD))
                     fprintf(ofile,"\"LTI%x\"\n",lti);
                 fprintf(ofile,"}}\n");
-                fprintf(ofile,"\"LTV%x\" -> \"LTI%x\" [color=blue]\n",ltv,ltv->sub.ltis);
+                fprintf(ofile,"\"LTV%x\" -> \"LTI%x\" [color=blue]\n",ltv,(ltv->flags&LT_HASH)?LTI_first(ltv):ltv->sub.ltis);
             }
         }
     }
@@ -726,6 +1866,10 @@ void ltvs2dot(FILE *ofile,CLL *ltvs,int maxdepth,char *label) {
                 REF_dot(ofile,ltv,"REFS");
         else if (ltv->flags&LT_CVAR)
             cif_dot_cvar(ofile, ltv);  // invoke reflection, customize label
+        else if (ltv->flags&LT_I64)
+            fprintf(ofile,"\"LTV%x\" [label=\"%lld\" shape=box style=filled fillcolor=gold color=%s]\n",ltv,LTV_INT(ltv),color);
+        else if (ltv->flags&LT_F64)
+            fprintf(ofile,"\"LTV%x\" [label=\"%g\" shape=box style=filled fillcolor=gold color=%s]\n",ltv,LTV_DBL(ltv),color);
         else if (ltv->flags&LT_IMM)
             fprintf(ofile,"\"LTV%x\" [label=\"%x (imm)\" shape=box style=filled fillcolor=gold color=%s]\n",ltv,ltv->data,color);
         else if (ltv->flags&LT_NULL)
@@ -794,6 +1938,10 @@ void ltvs2dot_simple(FILE *ofile,CLL *ltvs,int maxdepth,char *label) {
                 REF_dot(ofile, ltv, "REFS");
         else if (ltv->flags&LT_CVAR)
             cif_dot_cvar(ofile, ltv); // invoke reflection, customize label
+        else if (ltv->flags&LT_I64)
+            fprintf(ofile, "\"LTV%x\" [label=\"I(%lld)\" shape=box style=filled color=%s]\n", ltv, LTV_INT(ltv), color);
+        else if (ltv->flags&LT_F64)
+            fprintf(ofile, "\"LTV%x\" [label=\"F(%g)\" shape=box style=filled color=%s]\n", ltv, LTV_DBL(ltv), color);
         else if (ltv->flags&LT_IMM)
             fprintf(ofile, "\"LTV%x\" [label=\"I(%x)\" shape=box style=filled color=%s]\n", ltv, ltv->data, color);
         else if (ltv->flags==LT_NULL)
@@ -870,6 +2018,8 @@ int pickle_ltvs(FILE *ofile,char *pre,CLL *ltvs,char *post,int maxdepth)
                 if      ((*ltv)->flags&LT_REFS) { REF_printall(ofile,(*ltv),"REFS:\n"); fstrnprint(ofile,(*ltv)->data,(*ltv)->len); }
                 else if ((*ltv)->flags&LT_BC)   disassemble(ofile,(*ltv));
                 else if ((*ltv)->flags&LT_CVAR) cif_print_cvar(ofile,(*ltv),depth);
+                else if ((*ltv)->flags&LT_I64)  fprintf(ofile,"%lld",LTV_INT(*ltv));
+                else if ((*ltv)->flags&LT_F64)  fprintf(ofile,"%g",LTV_DBL(*ltv));
                 else if ((*ltv)->flags&LT_IMM)  fprintf(ofile,"IMM 0x%x",(*ltv)->data);
                 else if ((*ltv)->flags&LT_NULL) fprintf(ofile,"<null>");
                 else if ((*ltv)->flags&LT_BIN)  hexdump(ofile,(*ltv)->data,(*ltv)->len);
@@ -902,6 +2052,8 @@ int pickle_ltvs(FILE *ofile,char *pre,CLL *ltvs,char *post,int maxdepth)
                 if      ((*ltv)->flags&LT_REFS) { REF_printall(ofile,(*ltv),"REFS:\n"); fstrnprint(ofile,(*ltv)->data,(*ltv)->len); }
                 else if ((*ltv)->flags&LT_BC)   disassemble(ofile,(*ltv));
                 else if ((*ltv)->flags&LT_CVAR) cif_print_cvar(ofile,(*ltv),depth);
+                else if ((*ltv)->flags&LT_I64)  fprintf(ofile,"%lld",LTV_INT(*ltv));
+                else if ((*ltv)->flags&LT_F64)  fprintf(ofile,"%g",LTV_DBL(*ltv));
                 else if ((*ltv)->flags&LT_IMM)  fprintf(ofile,"IMM 0x%x",(*ltv)->data);
                 else if ((*ltv)->flags&LT_NULL) fprintf(ofile,"<null>");
                 else if ((*ltv)->flags&LT_BIN)  hexdump(ofile,(*ltv)->data,(*ltv)->len);
@@ -931,6 +2083,256 @@ int pickle_ltv(FILE *ofile,char *pre,LTV *ltv,char *post,int maxdepth)
     LTV_deq(&ltvs,HEAD);
 }
 
+//////////////////////////////////////////////////
+// Binary images
+// One prelinked file per listree: a header, a node table of LTV/LTI/LTVR
+// records laid out as in memory, the list of their pointer fields, and a string
+// pool. Pointer fields hold absolute addresses for the header's preferred base,
+// so when image_ltv_map gets that address nothing is parsed, copied or
+// written at load. Otherwise it falls back to an O(nodes) pass that shifts
+// every listed field, dirtying the node table. The mapping is private and
+// writable either way: refcounts, traversal marks and list links of mapped
+// nodes are updated in place, and only the pages that see such writes stop
+// being shared with the page cache. Every LTV comes back LT_RO. Dicts are
+// stored as balanced AA trees over the image's own sentinel, and rings as
+// linked lists. CVARs and REFs point into the writing process and are left out,
+// except for derived LTVs whose data is the LTV itself (e.g. TYPE_INFO_LTV),
+// which are stored whole.
+//////////////////////////////////////////////////
+
+#define LT_IMAGE_MAGIC "LTIMAGE3"
+#define LT_IMAGE_POOL (1ULL<<63) // writer-side tag: offset is relative to the string pool
+#define LT_IMAGE_BASE(h) (0x100000000000ULL+((uint64_t) ((h)&0xfff)<<32)) // preferred bases, 4GB apart, clear of heap/libs/stacks
+
+typedef struct {
+    char magic[8];
+    unsigned ltv_size,lti_size,ltvr_size,ptr_size; // must match the mapping process
+    uint64_t base;            // preferred mapping address; pointer fields are absolute for it
+    uint64_t root;            // root LTV record (file offset, as are the rest)
+    uint64_t nodes,nodes_len; // LTV/LTI/LTVR records
+    uint64_t relocs,nrelocs;  // file offsets of the records' pointer fields
+    uint64_t pool,pool_len;   // names and data
+} LT_IMAGE_HDR;
+
+typedef struct { char *buf; uint64_t len,size; } LT_IMAGE_BUF;
+
+// reserve len bytes (8-aligned), copying data in if given; returns the offset, or -1
+static uint64_t image_buf_add(LT_IMAGE_BUF *b,void *data,uint64_t len)
+{
+    uint64_t at=b->len,need=at+((len+7)&~7ULL);
+    if (need>b->size) {
+        uint64_t size=MAX(need,b->size*2+4096);
+        char *buf=RENEW(b->buf,size);
+        if (!buf)
+            return -1;
+        b->buf=buf,b->size=size;
+    }
+    memset(b->buf+at,0,need-at);
+    if (data)
+        memcpy(b->buf+at,data,len);
+    b->len=need;
+    return at;
+}
+
+int image_ltv_to_file(char *filename,LTV *root)
+{
+    int status=0;
+    LT_IMAGE_HDR hdr={.magic=LT_IMAGE_MAGIC,.ltv_size=sizeof(LTV),.lti_size=sizeof(LTI),.ltvr_size=sizeof(LTVR),.ptr_size=sizeof(void *)};
+    LT_IMAGE_BUF nodes={},relocs={},pool={},queue={},items={};
+    PTRMAP seen={},names={};
+    FILE *ofile=NULL;
+    uint64_t base=sizeof(hdr),sentinel=0;
+
+    uint64_t add(LT_IMAGE_BUF *b,void *data,uint64_t len) {
+        uint64_t at=image_buf_add(b,data,len);
+        if (at==(uint64_t) -1)
+            status=TRY_ERR,at=0;
+        return at;
+    }
+    void setptr(uint64_t at,uint64_t val) { // at is a node-table offset
+        uint64_t field=base+at;
+        add(&relocs,&field,sizeof(field));
+        if (!status)
+            memcpy(nodes.buf+at,&val,sizeof(val));
+    }
+    int derived(LTV *ltv) { return (ltv->flags&LT_CVAR) && ltv->data==ltv && ltv->len>=sizeof(LTV); }
+    int persists(LTV *ltv) { return derived(ltv) || !(ltv->flags&(LT_CVAR|LT_REFS)); }
+    uint64_t pooled(void *data,int len) {
+        uint64_t at=add(&pool,NULL,len+1);
+        if (!status)
+            memcpy(pool.buf+at,data,len);
+        return LT_IMAGE_POOL|at;
+    }
+    uint64_t name_ref(char *name,int len) { // interned, so one pool entry per distinct name
+        uint64_t ref=(uint64_t) ptrmap_get(&names,name);
+        if (!ref && !status && !ptrmap_put(&names,name,(void *) (ref=pooled(name,len))))
+            status=TRY_ERR;
+        return ref;
+    }
+    uint64_t ltv_ref(LTV *ltv) { // node-table offset of ltv's record, queueing it on first sight
+        uint64_t at=(uint64_t) ptrmap_get(&seen,ltv);
+        if (!at && !status) {
+            at=add(&nodes,NULL,derived(ltv)?ltv->len:sizeof(LTV))+1; // +1: offset 0 is valid, a NULL map entry isn't
+            if (!status && !ptrmap_put(&seen,ltv,(void *) at))
+                status=TRY_ERR;
+            add(&queue,&ltv,sizeof(ltv));
+        }
+        return at-1;
+    }
+    void emit_ltvs(uint64_t sentinel,CLL *ltvs) { // a linked LTVR chain, in order
+        items.len=0;
+        void *collect(LTV *ltv) { if (persists(ltv)) add(&items,&ltv,sizeof(ltv)); return NULL; }
+        LTV_each(ltvs,FWD,collect);
+        int n=items.len/sizeof(LTV *);
+        uint64_t first=n?add(&nodes,NULL,n*sizeof(LTVR)):0;
+        uint64_t at(int i) { return i<0 || i>=n?sentinel:first+i*sizeof(LTVR); }
+        for (int i=0;!status && i<n;i++) {
+            setptr(at(i)+offsetof(LTVR,lnk.lnk[FWD]),base+at(i+1));
+            setptr(at(i)+offsetof(LTVR,lnk.lnk[REV]),base+at(i-1));
+            setptr(at(i)+offsetof(LTVR,ltv),base+ltv_ref(((LTV **) items.buf)[i]));
+        }
+        setptr(sentinel+offsetof(CLL,lnk[FWD]),base+at(n?0:-1));
+        setptr(sentinel+offsetof(CLL,lnk[REV]),base+at(n-1));
+    }
+    void emit_ltis(uint64_t ltv_at,LTV *ltv) { // sorted LTI records, threaded and built into an AA tree
+        int n=0;
+        for (LTI *lti=LTI_first(ltv);lti;lti=LTI_iter(ltv,lti,FWD))
+            n++;
+        uint64_t first=n?add(&nodes,NULL,n*sizeof(LTI)):0;
+        uint64_t at(int i) { return first+((i+n)%n)*sizeof(LTI); }
+        uint64_t build(int lo,int len) {
+            if (!len || status)
+                return base+sentinel;
+            int mid=lo+(len-1)/2;
+            setptr(at(mid)+offsetof(LTI,lnk[LEFT]),build(lo,mid-lo));
+            setptr(at(mid)+offsetof(LTI,lnk[RIGHT]),build(mid+1,lo+len-mid-1));
+            if (!status)
+                ((LTI *) (nodes.buf+at(mid)))->level=31-__builtin_clz(len+1);
+            return base+at(mid);
+        }
+        int i=0;
+        for (LTI *lti=LTI_first(ltv);!status && lti;lti=LTI_iter(ltv,lti,FWD),i++) {
+            LTI *rec=(LTI *) (nodes.buf+at(i));
+            rec->len=lti->len;
+            memcpy(rec->preview,lti->preview,PREVIEWLEN);
+            setptr(at(i)+offsetof(LTI,name),name_ref(lti->name,lti->len));
+            setptr(at(i)+offsetof(LTI,thread[FWD]),base+at(i+1));
+            setptr(at(i)+offsetof(LTI,thread[REV]),base+at(i-1));
+            emit_ltvs(at(i)+offsetof(LTI,ltvs),&lti->ltvs);
+        }
+        setptr(ltv_at+offsetof(LTV,sub.ltis),build(0,n));
+        setptr(ltv_at+offsetof(LTV,sub.first),n?base+first:0);
+    }
+    void emit_ltv(LTV *ltv,uint64_t at) {
+        LTV *rec=(LTV *) (nodes.buf+at);
+        memcpy(rec,ltv,derived(ltv)?ltv->len:sizeof(LTV));
+        rec->flags=(ltv->flags&~(LT_FREE|LT_INL|LT_RING|LT_HASH|LT_RVIS))|LT_RO;
+        rec->refs=1;
+        rec->cows=0;
+        rec->avis=0;
+        if (derived(ltv))
+            setptr(at+offsetof(LTV,data),base+at);
+        else if (!(ltv->flags&LT_NAP))
+            setptr(at+offsetof(LTV,data),pooled(ltv->data,ltv->len));
+        if (ltv->flags&LT_LIST)
+            emit_ltvs(at+offsetof(LTV,sub.ltvs),&ltv->sub.ltvs);
+        else
+            emit_ltis(at,ltv);
+    }
+
+    STRY(!root || !persists(root),"validate listree image root");
+    STRY(!ptrmap_init(&seen,1024) || !ptrmap_init(&names,1024),"allocate listree image maps");
+    sentinel=add(&nodes,NULL,sizeof(LTI)); // level 0, linked to itself, like aa_sentinel
+    setptr(sentinel+offsetof(LTI,lnk[LEFT]),base+sentinel);
+    setptr(sentinel+offsetof(LTI,lnk[RIGHT]),base+sentinel);
+    hdr.root=base+ltv_ref(root);
+    for (uint64_t i=0;!status && i<queue.len/sizeof(LTV *);i++) {
+        LTV *ltv=((LTV **) queue.buf)[i];
+        emit_ltv(ltv,(uint64_t) ptrmap_get(&seen,ltv)-1);
+    }
+    STRY(status,"lay out listree image");
+
+    hdr.nodes=base;
+    hdr.nodes_len=nodes.len;
+    hdr.relocs=hdr.nodes+hdr.nodes_len;
+    hdr.nrelocs=relocs.len/sizeof(uint64_t);
+    hdr.pool=hdr.relocs+relocs.len;
+    hdr.pool_len=pool.len;
+    hdr.base=LT_IMAGE_BASE(strnhash(filename,strlen(filename)));
+    for (uint64_t i=0;i<hdr.nrelocs;i++) { // resolve pool-relative offsets now that the pool's place is known, then prelink
+        uint64_t *field=(uint64_t *) (nodes.buf+((uint64_t *) relocs.buf)[i]-base);
+        if (*field&LT_IMAGE_POOL)
+            *field=hdr.pool+(*field&~LT_IMAGE_POOL);
+        if (*field)
+            *field+=hdr.base;
+    }
+
+    STRY(!(ofile=fopen(filename,"w")),"open listree image %s",filename);
+    TRYCATCH(fwrite(&hdr,sizeof(hdr),1,ofile)!=1 ||
+             fwrite(nodes.buf,1,nodes.len,ofile)!=nodes.len ||
+             fwrite(relocs.buf,1,relocs.len,ofile)!=relocs.len ||
+             fwrite(pool.buf,1,pool.len,ofile)!=pool.len,TRY_ERR,close_file,"write listree image %s",filename);
+ close_file:
+    if (fclose(ofile) && !status)
+        status=TRY_ERR;
+ done:
+    ptrmap_free(&seen);
+    ptrmap_free(&names);
+    DELETE(nodes.buf);
+    DELETE(relocs.buf);
+    DELETE(pool.buf);
+    DELETE(queue.buf);
+    DELETE(items.buf);
+    return status;
+}
+
+LTV *image_ltv_map(char *filename)
+{
+    int status=0,fd=-1;
+    struct stat st;
+    char *base=MAP_FAILED;
+    LTV *root=NULL;
+    LT_IMAGE_HDR hdr;
+
+    int check(LT_IMAGE_HDR *hdr,uint64_t size) {
+        return memcmp(hdr->magic,LT_IMAGE_MAGIC,sizeof(hdr->magic)) || hdr->base!=LT_IMAGE_BASE(hdr->base>>32) ||
+            hdr->ltv_size!=sizeof(LTV) || hdr->lti_size!=sizeof(LTI) || hdr->ltvr_size!=sizeof(LTVR) || hdr->ptr_size!=sizeof(void *) ||
+            hdr->nodes<sizeof(*hdr) || hdr->nodes_len>size-hdr->nodes ||
+            hdr->relocs<hdr->nodes+hdr->nodes_len || hdr->relocs%sizeof(uint64_t) || hdr->nrelocs>(size-hdr->relocs)/sizeof(uint64_t) ||
+            hdr->root<hdr->nodes || hdr->root+sizeof(LTV)>hdr->nodes+hdr->nodes_len;
+    }
+
+    STRY((fd=open(filename,O_RDONLY))<0,"open listree image %s",filename);
+    TRYCATCH(fstat(fd,&st) || st.st_size<sizeof(hdr) || pread(fd,&hdr,sizeof(hdr),0)!=sizeof(hdr),TRY_ERR,close_file,"read listree image %s",filename);
+    TRYCATCH(check(&hdr,st.st_size),TRY_ERR,close_file,"validate listree image %s",filename);
+    if ((base=mmap((void *) hdr.base,st.st_size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_FIXED_NOREPLACE,fd,0))==MAP_FAILED) // taken; map anywhere
+        base=mmap(NULL,st.st_size,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0);
+    TRYCATCH(base==MAP_FAILED,TRY_ERR,close_file,"map listree image %s",filename);
+    if (base!=(char *) hdr.base) { // not where it was prelinked for: shift every pointer field
+        uint64_t *reloc=(uint64_t *) (base+hdr.relocs);
+        for (uint64_t i=0;i<hdr.nrelocs;i++) {
+            uint64_t field=reloc[i],addr;
+            TRYCATCH(field<hdr.nodes || field+sizeof(void *)>hdr.nodes+hdr.nodes_len || field%sizeof(void *) ||
+                     ((addr=*(uint64_t *) (base+field)) && addr-hdr.base>=st.st_size),TRY_ERR,unmap,"relocate listree image %s",filename);
+            if (addr)
+                *(char **) (base+field)=base+(addr-hdr.base);
+        }
+    }
+
+    pthread_mutex_lock(&lt_image_mutex);
+    if (!lt_image_add((LT_IMAGE) {base,st.st_size}))
+        root=(LTV *) (base+hdr.root);
+    pthread_mutex_unlock(&lt_image_mutex);
+    TRYCATCH(!root,TRY_ERR,unmap,"register listree image %s",filename);
+    goto close_file;
+ unmap:
+    munmap(base,st.st_size);
+ close_file:
+    close(fd);
+ done:
+    return root;
+}
+
 //////////////////////////////////////////////////
 //////////////////////////////////////////////////
 
@@ -941,21 +2343,28 @@ LTV *LTV_deq(CLL *ltvs,int end)          { return LTV_get((ltvs),POP,(end),NULL,
 LTV *LTV_peek(CLL *ltvs,int end)         { return LTV_get((ltvs),KEEP,(end),NULL,NULL); }
 
 LTV *LT_put(LTV *parent,char *name,int end,LTV *child) {
+    LTV *ltv=NULL;
     if (parent && name && child) {
+        int locked=lt_rcu_lock();
         LTI *lti=LTI_resolve(parent,name,true);
-        return lti?LTV_enq(&lti->ltvs,child,end):NULL;
+        ltv=lti?LTV_enq(&lti->ltvs,child,end):NULL;
+        lt_rcu_unlock(locked);
     }
-    else
-        return NULL;
+    return ltv;
 }
 
 LTV *LT_get(LTV *parent,char *name,int end,int pop) {
+    int status=0;
+    LTV *ltv=NULL;
     if (parent && name) {
+        STRY(pop && ltv_shared(parent),"popping from an ltv shared with a snapshot (see LTV_cow)");
+        int locked=lt_rcu_lock();
         LTI *lti=LTI_resolve(parent,name,false);
-        return lti?(pop?LTV_deq(&lti->ltvs,end):LTV_peek(&lti->ltvs,end)):NULL;
+        ltv=lti?(pop?LTV_deq(&lti->ltvs,end):LTV_peek(&lti->ltvs,end)):NULL;
+        lt_rcu_unlock(locked);
     }
-    else
-        return NULL;
+ done:
+    return ltv;
 }
 
 
@@ -964,8 +2373,6 @@ LTV *LT_get(LTV *parent,char *name,int end,int pop) {
 // special case; client creates ref, which acts as sentinel
 //////////////////////////////////////////////////
 
-int ref_count=0;
-
 REF *REF_HEAD(LTV *ltv) { return ((REF *) CLL_HEAD(&ltv->sub.ltvs)); }
 REF *REF_TAIL(LTV *ltv) { return ((REF *) CLL_TAIL(&ltv->sub.ltvs)); }
 
@@ -976,6 +2383,14 @@ REF *refpop(CLL *cll)           { return (REF *) CLL_get(cll,POP,HEAD); }
 
 LTV *REF_root(REF *ref) { return ref?LTV_peek(&ref->root,HEAD):NULL; }
 
+// cut an ltvr out of a (possibly shared) lti's ltvs under its stripe, then release it
+static void ref_cut(CLL *ltvs,LTVR *ltvr) {
+    LT_STRIPE *stripe=lt_lock(ltvs);
+    CLL_cut(&ltvr->lnk);
+    lt_unlock(stripe);
+    LTVR_release(&ltvr->lnk);
+}
+
 REF *REF_init(REF *ref,char *data,int len)
 {
     int quote=(len>1 && data[0]=='\'' && data[len-1]=='\'');
@@ -990,35 +2405,77 @@ REF *REF_init(REF *ref,char *data,int len)
     if (ref && CLL_init(&ref->lnk))
     {
         CLL_init(&ref->keys);
-        LTV_enq(&ref->keys,LTV_init(NEW(LTV),data+rev,len-rev,LT_DUP|(quote?LT_NOWC:LT_ESC)),HEAD);
+        LTV *name=LTV_enq(&ref->keys,LTV_init(NEW(LTV),data+rev,len-rev,LT_DUP|(quote?LT_NOWC:LT_ESC)),HEAD);
         CLL_init(&ref->root);
         ref->lti=NULL;
+        ref->name=NULL;
         ref->ltvr=NULL;
         ref->cvar=NULL;
+        ref->glob.pat=NULL;
+        if (LTV_wildcard(name)) // compile once, reused by every resolve/iterate
+            glob_compile(&ref->glob,name->data,name->len);
         ref->reverse=rev;
-        ref_count++;
+        STAT_ADD(STAT_REF,1);
     }
     return ref;
 }
 
+// cache a glob ref's lti along with its name, which (unlike the lti) can't be reclaimed out from under the ref
+static void ref_pin(REF *ref,LTI *lti)
+{
+    char *name=ref->glob.pat && !LTI_invalid(lti)?strintern(lti->name,lti->len):NULL;
+    if (ref->name)
+        strunintern(ref->name);
+    ref->name=name;
+    ref->lti=lti;
+}
+
+// Once lt_concurrent, the lti/ltvr a ref cached on an earlier resolve may since have been removed
+// (and reclaimed) by another thread; keep them only if one lookup by name still finds the same pointers.
+static void ref_revalidate(REF *ref,LTV *root)
+{
+    LTV *key=LTV_peek(&ref->keys,HEAD);
+    LTI *lti=NULL;
+    if (!LT_CONCURRENT || !ref->lti || !root || !key)
+        return;
+    int locked=lt_rcu_lock(); // from the lookup through the ltvr scan
+    if (root->flags&(LT_CVAR|LT_LIST))
+        lti=NULL;
+    else if (ref->glob.pat)
+        lti=ref->name?ltv_lookup(root,ref->name,strinterned_len(ref->name)):NULL;
+    else
+        lti=ltv_lookup(root,key->data,key->len);
+    if (LTI_invalid(lti) || lti!=ref->lti) {
+        ref_pin(ref,NULL);
+        ref->ltvr=NULL;
+    }
+    else if (ref->ltvr) {
+        void *cached(CLL *lnk) { return lnk==&ref->ltvr->lnk?lnk:NULL; }
+        if (!CLL_map(&lti->ltvs,FWD,cached))
+            ref->ltvr=NULL;
+    }
+    lt_rcu_unlock(locked);
+}
+
 LTV *REF_reset(REF *ref,LTV *newroot)
 {
     int status=0;
     LTV *root=REF_root(ref);
+    ref_revalidate(ref,root);
     if (root==newroot)
         goto done;
-    if (root && ref->lti) {
+    if (root && ref->lti && !ltv_shared(root)) { // don't touch a root shared with a snapshot
         void *prune_placeholders(CLL *lnk) {
             LTVR *ltvr=(LTVR *) lnk;
             if (ltvr->ltv->flags==LT_NULL && LTV_empty(ltvr->ltv)) //////// no flags at all?????
-                LTVR_release(lnk);
+                ref_cut(&ref->lti->ltvs,ltvr);
             return (void *) NULL;
         }
         CLL_map(&ref->lti->ltvs,FWD,prune_placeholders);
         if (CLL_EMPTY(&ref->lti->ltvs)) // if LTI is pruneable
             LTV_erase(root,ref->lti); // prune it
     }
-    ref->lti=NULL;
+    ref_pin(ref,NULL);
     ref->ltvr=NULL;
     LTV_release(ref->cvar);
     CLL_release(&ref->root,LTVR_release);
@@ -1036,7 +2493,7 @@ void REF_free(CLL *lnk)
     REF_reset(ref,NULL);
     CLL_release(&ref->keys,LTVR_release);
     RELEASE(ref);
-    ref_count--;
+    STAT_ADD(STAT_REF,-1);
 }
 
 ///////////////////////////////////////////////////////
@@ -1048,7 +2505,7 @@ LTV *REF_create(LTV *refs)
     if (!(refs->flags&LT_REFS)) { // promote an ltv to a ref
         STRY(!LTV_empty(refs),"promoting non-empty ltv to ref");
         STRY(refs->flags&(LT_CVAR|LT_NAP|LT_NSTR|LT_REFL),"promoting incompatible ltv to ref");
-        refs->flags|=(LT_REFS|LT_LIST);
+        refs->flags=(refs->flags&~LT_HASH)|LT_REFS|LT_LIST;
         CLL_init(&refs->sub.ltvs);
     }
     char *data=refs->data;
@@ -1103,7 +2560,7 @@ int REF_resolve(LTV *root_ltv,LTV *refs,int insert)
     STRY(!refs || !(refs->flags&LT_REFS),"validating params");
     CLL *cll=LTV_list(refs);
     REF *ref=NULL;
-    int placeholder=0;
+    int placeholder=0,locked=0;
 
     void *resolve(CLL *lnk) {
         int status=0;
@@ -1123,7 +2580,11 @@ int REF_resolve(LTV *root_ltv,LTV *refs,int insert)
             root=ref->cvar;
         else {
             if (!ref->lti) { // resolve lti
-                if ((status=LTI_invalid(ref->lti=LTI_lookup(root,name,insert))))
+                if (ref->glob.pat) // a match may be a placeholder; materialize it as LTV_find would
+                    ref_pin(ref,lti_lazy(root,LTI_glob(root,&ref->glob,NULL)));
+                else
+                    ref->lti=LTI_lookup(root,name,insert);
+                if ((status=LTI_invalid(ref->lti)))
                     goto done; // return failure, but don't log it
             }
             if (!ref->ltvr) { // resolve ltv(r)
@@ -1132,7 +2593,11 @@ int REF_resolve(LTV *root_ltv,LTV *refs,int insert)
                 if (status) // found LTI but no matching LTV
                     goto done;
             }
-            root=ref->ltvr->ltv;
+            if (insert && ref!=REF_HEAD(refs)) // interior nodes are about to be mutated; unshare them
+                root=LTV_cow(ref->ltvr);
+            else
+                root=ref->ltvr->ltv;
+            STRY(!root,"unsharing ltv");
         }
         goto done; // success!
 
@@ -1146,11 +2611,13 @@ int REF_resolve(LTV *root_ltv,LTV *refs,int insert)
     STRY(!cll,"validating refs");
     if (!root)
         STRY(!(root=REF_root(REF_TAIL(refs))),"validating root");
+    locked=lt_rcu_lock(); // ltis/ltvs found along the way (and the placeholder's lti) stay valid until we're done
     status=(CLL_map(cll,REV,resolve)!=NULL);
     if (placeholder) { // remove terminal placeholder
-        LTVR_release(&ref->ltvr->lnk);
+        ref_cut(&ref->lti->ltvs,ref->ltvr);
         ref->ltvr=NULL;
     }
+    lt_rcu_unlock(locked);
  done:
     return status;
 }
@@ -1168,18 +2635,20 @@ int REF_iterate(LTV *refs,int pop)
         LTV *name=LTV_get(&ref->keys,KEEP,HEAD,NULL,&name_ltvr);
         LTVR *val=(LTVR *) CLL_next(&ref->keys,&name_ltvr->lnk,FWD); // val will be next key
 
+        ref_revalidate(ref,REF_root(ref));
         if (!ref->lti || !ref->ltvr)
             goto done;
         LTV *next_ltv=LTV_get(&ref->lti->ltvs,KEEP,ref->reverse,val?val->ltv:NULL,&ref->ltvr);
         if (pop)
-            LTVR_release(&ref_ltvr->lnk);
+            ref_cut(&ref->lti->ltvs,ref_ltvr);
         if (next_ltv)
             return (void *) ref;
 
-        if (LTV_wildcard(name)) {
+        if (ref->glob.pat) {
             LTV *root=REF_root(ref);
             LTI *lti=ref->lti;
-            for (ref->lti=LTI_iter(root,ref->lti,FWD); !LTI_invalid(ref->lti) && fnmatch_len(name->data,name->len,ref->lti->name,-1); ref->lti=LTI_iter(root,ref->lti,FWD)); // find next lti
+            LTI *next=LTI_iter(root,lti,FWD);
+            ref_pin(ref,next?lti_lazy(root,LTI_glob(root,&ref->glob,next)):NULL); // find next lti
 
             if (CLL_EMPTY(&lti->ltvs)) // if LTI is pruneable
                 LTV_erase(root,lti); // prune it
@@ -1194,6 +2663,8 @@ int REF_iterate(LTV *refs,int pop)
     }
 
     STRY(!cll,"validating arguments");
+    if (pop)
+        STRY(REF_own(refs),"unsharing ref path");
     if (CLL_map(cll,FWD,iterate))
         STRY(REF_resolve(NULL,refs,false),"resolving iterated ref");
 
@@ -1201,6 +2672,25 @@ int REF_iterate(LTV *refs,int pop)
     return status;
 }
 
+// unshare a resolved ref's interior path so its head lti belongs to this tree alone
+int REF_own(LTV *refs)
+{
+    int status=0;
+    STRY(!refs || !(refs->flags&LT_REFS),"validating params");
+    int shared=0;
+    void *check(CLL *lnk) {
+        REF *ref=(REF *) lnk;
+        LTV *root=REF_root(ref);
+        shared|=root && ltv_shared(root);
+        return NULL;
+    }
+    CLL_map(LTV_list(refs),REV,check);
+    if (shared)
+        STRY(REF_resolve(NULL,refs,true),"re-resolving ref for mutation");
+ done:
+    return status;
+}
+
 int REF_assign(LTV *refs,LTV *ltv)
 {
     int status=0;
@@ -1214,6 +2704,7 @@ int REF_assign(LTV *refs,LTV *ltv)
     if (ref_ltv && ref_cvar(REF_root(ref)))
         STRY(!cif_assign_cvar(ref_ltv,ltv),"assigning to cvar");
     else {
+        STRY(REF_own(refs),"unsharing ref path");
         STRY(!ref->lti,"validating ref lti");
         STRY(!LTV_put(&ref->lti->ltvs,ltv,ref->reverse,&ref->ltvr),"adding ltv to ref");
     }
@@ -1226,12 +2717,13 @@ int REF_replace(LTV *refs,LTV *ltv)
 {
     int status=0;
     STRY(!refs || !(refs->flags&LT_REFS),"validating params");
+    STRY(REF_own(refs),"unsharing ref path");
     REF *ref=REF_HEAD(refs);
     LTVR *ref_ltvr=REF_ltvr(ref);
     STRY(!REF_lti(ref),"validating ref lti");
     STRY(!LTV_put(&ref->lti->ltvs,ltv,ref->reverse,&ref->ltvr),"replacing/adding rev ltv");
     if (ref_ltvr) // remove old ref if it existed
-        LTVR_release(&ref_ltvr->lnk);
+        ref_cut(&ref->lti->ltvs,ref_ltvr);
  done:
     return status;
 }
@@ -1241,9 +2733,10 @@ int REF_remove(LTV *refs)
 {
     int status=0;
     STRY(!refs || !(refs->flags&LT_REFS),"validating params");
+    STRY(REF_own(refs),"unsharing ref path");
     REF *ref=REF_HEAD(refs);
     STRY(!ref->lti || !ref->ltvr,"validating ref lti, ltvr");
-    LTVR_release(&ref->ltvr->lnk);
+    ref_cut(&ref->lti->ltvs,ref->ltvr);
     ref->ltvr=NULL;
  done:
     return status;
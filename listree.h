@@ -44,8 +44,13 @@
 
 #include <stdio.h>
 #include "cll.h"
+#include "util.h" // GLOB
 
 extern int show_ref;
+extern int lt_concurrent; // writers (and AA-tree readers) lock, LT_HASH readers go RCU, once set (see listree.c); read it with LT_CONCURRENT
+#define LT_CONCURRENT __atomic_load_n(&lt_concurrent,__ATOMIC_ACQUIRE)
+extern int lt_concurrent_enter(int pin); // before a second thread can see shared trees; returns the previous mode. pin: the thread outlives the caller, so never leave again
+extern void lt_concurrent_restore(int concurrent); // the only thread left, after joining its helpers: stops the reclaimer, drains deferred frees; a no-op once pinned
 
 typedef enum {
     LT_NONE =0,
@@ -64,49 +69,86 @@ typedef enum {
     LT_NOWC =0x00001000, // do not do wildcard matching
     LT_BC   =0x00002000, // VM bytecode
     LT_DERV =0x00004000, // Derived from another LTV (cannot be an LT_LIST)
+    LT_INL  =0x00008000, // LT_DUP'ed data fit in the LTV's own inline buffer; nothing to free
 
     LT_RO   =0x00010000, // META: disallow release
-    LT_AVIS =0x00020000, // META: absolute traversal visitation flag
     LT_RVIS =0x00040000, // META: recursive traversal visitation flag
     LT_LIST =0x00080000, // META: hold children in unlabeled list, rather than default rbtree
-    LT_NAP  =LT_IMM|LT_NULL,                // not a pointer
-    LT_FREE =LT_DUP|LT_OWN,                 // need to free data upon release
-    LT_META =LT_RO|LT_AVIS|LT_RVIS|LT_LIST, // need to be preserved during LTV_renew
+    LT_HASH =0x00100000, // META: index children by name hash, rather than default rbtree (ordered lazily)
+    LT_I64  =0x00200000, // LT_IMM data slot holds a native int64 (see LTV_INT)
+    LT_F64  =0x00400000, // LT_IMM data slot holds a native double (see LTV_DBL)
+    LT_RING =0x00800000, // META: LT_LIST held in a contiguous ring buffer rather than linked LTVRs (see LTV_ring)
+    LT_LAZY =0x01000000, // META: placeholder value, or a dict holding some; lookups hand them to LTV_lazy
+    LT_NUM  =LT_I64|LT_F64,                         // native number; no text to parse
+    LT_NAP  =LT_IMM|LT_NULL,                        // not a pointer
+    LT_FREE =LT_DUP|LT_OWN,                         // need to free data upon release (unless LT_INL)
+    LT_META =LT_RO|LT_RVIS|LT_LIST|LT_HASH|LT_RING|LT_LAZY, // need to be preserved during LTV_renew
     LT_REFL =LT_TYPE|LT_FFI|LT_CIF,         // used for reflection; visibility controlled by "show_ref"
     LT_NSTR =LT_NAP|LT_BIN|LT_CVAR|LT_REFL, // not a string
-    LT_NDUP =LT_FREE|LT_REFS|LT_CVAR|LT_REFL|LT_LIST, // need to be excised during LTV_dup
+    LT_NDUP =LT_FREE|LT_INL|LT_REFS|LT_CVAR|LT_REFL|LT_LIST|LT_RING|LT_LAZY, // need to be excised during LTV_dup
 } LTV_FLAGS;
 
 struct LTI;
 typedef struct LTI LTI;
 
 typedef struct {
+    unsigned mask;   // slot count-1
+    LTI *slot[];     // open addressing on the interned name's hash
+} LTI_SLOTS;         // replaced whole on resize, so readers always see a matching mask and array
+
+typedef struct {
+    LTI_SLOTS *slots;
+    unsigned count;  // live LTIs
+    unsigned used;   // live LTIs plus tombstones
+    int ordered;     // sorted ring (LTI.thread) is current
+    LTI **sorted;    // the ring as an array, for seeks; dropped on any change
+} LTI_HASH;
+
+enum { LTV_INLINE=16 }; // LT_DUP payloads shorter than this (leaving room for the terminator) live in LTV.inl
+
+typedef union { void *data; long long i; double d; } LT_IMMVAL; // an LT_IMM data slot, reinterpreted
+
+typedef struct LTV {
     union {
         CLL ltvs;
-        LTI *ltis;
+        struct {
+            union {
+                LTI *ltis;
+                LTI_HASH *hash; // LT_HASH; NULL until first insert
+            };
+            LTI *first; // head of the sorted LTI ring; NULL when empty
+        };
     } sub;
     LTV_FLAGS flags;
-    void *data;
     int len;
+    void *data;
     int refs;
+    int cows; // snapshot links (LTVR.cow) holding this ltv; shared with a snapshot while >1
+    char inl[LTV_INLINE]; // short LT_DUP payloads; data points here when LT_INL
+    union {
+        unsigned avis;     // epoch of the last traversal to visit (see listree_acyclic)
+        struct LTV *dying; // next in the reclaim queue, once refs==LTV_DYING and nothing can traverse here
+    };
 #ifdef VIZ
     fvec pos,vel;
 #endif
 } LTV; // LisTree Value
 
-typedef struct {
+typedef struct LTVR {
     CLL lnk;
     LTV *ltv;
+    int cow; // link made or shared by LTV_snapshot; counted in ltv->cows
 } LTVR; // LisTree Value Reference
 
-enum { RIGHT=0,LEFT=1,PREVIEWLEN=5,INSERT=4,ITER=8 }; // RIGHT==FWD, LEFT==REV
+enum { RIGHT=0,LEFT=1,PREVIEWLEN=5,INSERT=4 }; // RIGHT==FWD, LEFT==REV
 
 // FWD/REV define whether Left is processed before right or vice/versa for each of INFIX/PREFIX/POSTFIX
 enum { /*FWD=0,REV=1,*/ INFIX=1<<1,PREFIX=2<<1,POSTFIX=3<<1,TREEDIR=INFIX|PREFIX|POSTFIX };
 
 struct LTI {
-    LTI *lnk[2]; // AA TREE LEFT/RIGHT
-    char *name;
+    LTI *lnk[2];    // AA TREE LEFT/RIGHT
+    LTI *thread[2]; // sorted ring FWD/REV (next/prev)
+    char *name;  // interned; see strintern
     CLL ltvs;
     unsigned short len;
     unsigned char level,preview[PREVIEWLEN];
@@ -123,9 +165,22 @@ extern LTV *LTV_renew(LTV *ltv,void *data,int len,LTV_FLAGS flags);
 extern void LTV_free(LTV *ltv);
 extern int  LTV_is_empty(LTV *ltv);
 extern void *LTV_map(LTV *ltv,int reverse,LTI_OP lti_op,CLL_OP cll_op);
+// Once lt_concurrent, an lti that LTV_find/LTI_* hand back may be removed and reclaimed by another thread
+// as soon as no read-side section covers it: hold one from the lookup through the last use of the lti
+// (LT_get/LT_put/REF_resolve do). Sections nest, and nothing inside one may wait out a grace period.
+extern int LT_read_lock(); // returns whether a section was entered, for LT_read_unlock
+extern void LT_read_unlock(int locked);
 extern LTI *LTV_find(LTV *ltv,char *name,int len,int insert);
+extern LTI *(*LTV_lazy)(LTV *ltv,LTI *lti); // materializer for a LT_LAZY dict's placeholders, called on non-inserting finds
 extern LTI *LTV_remove(LTV *ltv,char *name,int len);
 
+typedef struct { char *name; int len; LTV *ltv; } LT_BULK; // one name/value pair for LTV_bulk
+enum {
+    LT_BULK_SORTED=1, // pairs already in name order (stable sort otherwise)
+    LT_BULK_FIRST =2  // only the first value per name, and only if ltv has none yet; others are released
+};
+extern int LTV_bulk(LTV *ltv,LT_BULK *pairs,int n,int flags); // add n pairs at once; returns how many went in, or -1 (values are consumed either way)
+
 extern LTVR *LTVR_init(LTVR *ltvr,LTV *ltv);
 extern LTV *LTVR_free(LTVR *ltvr);
 
@@ -137,6 +192,8 @@ extern int LTI_invalid(LTI *lti);
 // Tag Team of release methods for LT elements
 //////////////////////////////////////////////////
 extern void LTV_release(LTV *ltv);
+extern int LTV_reclaim(int budget); // tear down queued releases (budget<0: all); returns LTVs still pending
+extern int LTV_idle(); // LTV_reclaim a slice unless the background reclaimer has it; call when idle
 extern void LTVR_release(CLL *cll);
 extern void LTI_release(LTI *lti);
 
@@ -163,10 +220,20 @@ extern void *listree_acyclic(LTI **lti,LTVR *ltvr,LTV **ltv,int depth,LT_TRAVERS
 #define LTV_NULL      LTV_init(NEW(LTV),NULL,0,LT_NULL)
 #define LTV_ZERO      LTV_init(NEW(LTV),NULL,sizeof(NULL),LT_IMM)
 #define LTV_NULL_LIST LTV_init(NEW(LTV),NULL,0,LT_NULL|LT_LIST)
-
+#define LTV_NULL_HASH LTV_init(NEW(LTV),NULL,0,LT_NULL|LT_HASH)
+#define LTV_NULL_RING LTV_init(NEW(LTV),NULL,0,LT_NULL|LT_LIST|LT_RING)
+#define LTV_I64(val)  LTV_init(NEW(LTV),((LT_IMMVAL) {.i=(val)}).data,0,LT_IMM|LT_I64)
+#define LTV_F64(val)  LTV_init(NEW(LTV),((LT_IMMVAL) {.d=(val)}).data,0,LT_IMM|LT_F64)
+#define LTV_INT(ltv)  (((LT_IMMVAL) {.data=(ltv)->data}).i)
+#define LTV_DBL(ltv)  (((LT_IMMVAL) {.data=(ltv)->data}).d)
+
+// LTI_first/LTI_iter/LTI_seek/LTI_glob walk structure: a LT_LAZY dict's placeholders come back as-is.
+// Lookups by name (LTV_find) and glob refs (REF_resolve/REF_iterate) materialize them via LTV_lazy.
 extern LTI *LTI_first(LTV *ltv);
 extern LTI *LTI_last(LTV *ltv);
 extern LTI *LTI_iter(LTV *ltv,LTI *lti,int dir);
+extern LTI *LTI_seek(LTV *ltv,char *name,int len); // first lti sorting at or after "name"
+extern LTI *LTI_glob(LTV *ltv,GLOB *glob,LTI *from); // first lti matching glob, starting at "from" (NULL: seek to glob's prefix)
 extern LTI *LTI_lookup(LTV *ltv,LTV *name,int insert); // find (or insert) lti matching "name" in ltv
 extern LTI *LTI_find(LTV *ltv,char *name,int insert,int flags); // wraps name with LTV/flags
 extern LTI *LTI_resolve(LTV *ltv,char *name,int insert); // lookup, via string name no wildcards
@@ -178,6 +245,14 @@ extern void LTV_erase(LTV *ltv,LTI *lti);
 
 extern LTV *LTV_dup(LTV *ltv);
 extern LTV *LTV_copy(LTV *ltv,int maxdepth);
+// A snapshot's children are linked from both trees until one side writes. LTV_find(insert) unshares
+// (LTV_cow) the values under the name it finds, so inserting finds/LT_put/REF_resolve clone just the
+// path they walk; LTV_put/LTV_remove/LTV_erase then only ever touch nodes their tree owns. Reaching a
+// still-shared node some other way, LTV_find(insert)/LTV_remove/LT_get(POP) fail rather than write
+// through to the other tree; LTV_get/LTV_deq see only a bare CLL, so only pop lists your tree owns.
+// Ring-form lists hand out no LTVRs, so their items are shared outright, as LTV_copy does.
+extern LTV *LTV_snapshot(LTV *ltv); // new ltv sharing ltv's children copy-on-write
+extern LTV *LTV_cow(LTVR *ltvr); // make ltvr's ltv exclusively owned (cloning if shared), return it
 extern LTV *LTV_concat(LTV *a,LTV *b);
 extern int LTV_wildcard(LTV *ltv);
 
@@ -191,8 +266,21 @@ extern void graph_ltvs(FILE *ofile,CLL *ltvs,int maxdepth,char *label);
 extern void graph_ltvs_to_file(char *filename,CLL *ltvs,int maxdepth,char *label);
 extern void graph_ltv_to_file(char *filename,LTV *ltv,int maxdepth,char *label);
 
+extern int image_ltv_to_file(char *filename,LTV *ltv); // binary, relocatable image of ltv's tree (CVARs and REFs excluded, save self-contained derived LTVs)
+extern LTV *image_ltv_map(char *filename);            // map an image read-only (LT_RO, never freed); NULL on failure
+
 extern CLL *LTV_list(LTV *ltv);
 
+// a list handle (LTV_list, or a bare CLL; not lti->ltvs, which refs walk by LTVR) may switch to ring storage while empty;
+// LTV_put/get/enq/deq/peek work on either kind, but a ring hands out no LTVRs (ltvr_ret comes back NULL)
+typedef void *(*LTV_OP)(LTV *ltv);
+extern CLL *LTV_ring(CLL *ltvs);                  // switch an empty list to ring storage; NULL if it isn't empty
+extern int LTV_ringed(CLL *ltvs);
+extern int LTV_len(CLL *ltvs);                    // O(1) for rings
+extern LTV *LTV_at(CLL *ltvs,int index,int end);  // index'th ltv from end, or NULL; O(1) for rings
+extern void *LTV_each(CLL *ltvs,int dir,LTV_OP op); // op each ltv until it returns non-NULL; returns that
+extern CLL *LTV_merge(CLL *dst,CLL *src,int end); // move src's ltvs, in order, to dst's end (CLL_MERGE for either kind)
+
 extern LTV *LTV_enq(CLL *ltvs,LTV *ltv,int end);
 extern LTV *LTV_deq(CLL *ltvs,int end);
 extern LTV *LTV_peek(CLL *ltvs,int end);
@@ -212,8 +300,10 @@ typedef struct REF {
     CLL keys;   // name(/value) lookup key(s)
     CLL root;   // LTV being queried
     LTI *lti;   // name lookup result
+    char *name; // a glob ref's lti name, interned (see ref_revalidate)
     LTVR *ltvr; // value lookup result
     LTV *cvar;  // cvar deref result
+    GLOB glob;  // name key, compiled if it's a wildcard
     int reverse;
 } REF;
 
@@ -231,6 +321,7 @@ extern int REF_iterate(LTV *refs,int pop);
 extern int REF_assign(LTV *refs,LTV *ltv);
 extern int REF_replace(LTV *refs,LTV *ltv);
 extern int REF_remove(LTV *refs);
+extern int REF_own(LTV *refs); // clone shared copy-on-write ltvs along a resolved ref's path
 
 extern LTI *REF_lti(REF *ref);
 extern LTVR *REF_ltvr(REF *ref);
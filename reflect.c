@@ -40,14 +40,18 @@
 #include <fcntl.h>     /* For open() */
 #include <unistd.h>    /* For close() */
 #include <errno.h>
+#include <time.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdarg.h>
 
 #include <libdwarf/dwarf.h>
 #include <libdwarf/libdwarf.h>
 #include <dlfcn.h> // dlopen/dlsym/dlclose
 #include <arpa/inet.h>
+#include <pthread.h>
+#include <linux/btf.h>
 
 #include <ffi.h>
 
@@ -57,7 +61,8 @@
 #include "vm.h"
 #include "extensions.h"
 
-static int cif_curate_module(LTV *module, int bootstrap);
+static int cif_curate_module(LTV *module, int bootstrap, Dwarf_Off only_cu);
+static int cif_cache_load(LTV *module,int bootstrap);
 
 LTV *cif_module = NULL; // initialized/populated during bootstrap
 
@@ -66,16 +71,20 @@ void cif_init(int bootstrap) {
         Dl_info dl_info;
         dladdr((void *)cif_init, &dl_info);
         fprintf(stderr, CODE_RED "reflection module path is: %s" CODE_RESET "\n", dl_info.dli_fname);
-        cif_module = LTV_init(NEW(LTV), (char *)dl_info.dli_fname, strlen(dl_info.dli_fname), LT_DUP | LT_RO);
-        cif_preview_module(cif_module);
+        cif_module = LTV_init(NEW(LTV), (char *)dl_info.dli_fname, strlen(dl_info.dli_fname), LT_DUP | LT_RO | LT_HASH);
+        if (cif_cache_load(cif_module, bootstrap)) { // not curated for this build yet
+            cif_preview_module(cif_module);
 
-        print_ltv(stderr, CODE_RED, cif_module, CODE_RESET "\n", 0);
-        cif_curate_module(cif_module, bootstrap);
+            print_ltv(stderr, CODE_RED, cif_module, CODE_RESET "\n", 0);
+            cif_curate_module(cif_module, bootstrap, 0);
+        }
     }
 }
 
 char *Type_pushUVAL(TYPE_UVALUE *uval,char *buf);
 TYPE_UVALUE *Type_pullUVAL(TYPE_UVALUE *uval,char *buf);
+TYPE_UVALUE *Type_immUVAL(TYPE_UVALUE *uval,LTV *imm);
+TYPE_UVALUE *Type_numUVAL(TYPE_UVALUE *uval,long long i,double d);
 TYPE_UTYPE Type_getUVAL(LTV *cvar,TYPE_UVALUE *uval);
 int Type_putUVAL(LTV *cvar,TYPE_UVALUE *uval);
 /////////////////////////////////////////////////////////////
@@ -165,37 +174,64 @@ static char *DW_IDX_STRING[] = {"header_cu_type==0 (invalid)",
                                 "DW_UT_lo_user",
                                 "DW_UT_hi_user" };
 
-int traverse_cus(char *filename,DIE_OP op,CU_DATA *cu_data,DIEWALK_FLAGS flags)
+// run op against a dwarf reader opened on filename
+static int dwarf_session(char *filename,int (*op)(Dwarf_Debug dbg))
 {
     int status=0;
     Dwarf_Debug dbg;
     Dwarf_Error error=0;
+    int filedesc = -1;
+    STRY((filedesc=open(filename,O_RDONLY))<0,"open dwarf2edict input file %s",filename);
+    TRYCATCH(dwarf_init(filedesc,DW_DLC_READ,NULL,NULL,&dbg,&error),status,close_file,"initialize dwarf reader");
+    TRYCATCH(op(dbg),status,close_dwarf,"read dwarf");
+ close_dwarf:
+    STRY(dwarf_finish(dbg,&error),"finalize dwarf reader");
+ close_file:
+    close(filedesc);
+ done:
+    return status;
+}
 
-    int read_cu_list() {
-        CU_DATA cu_data_local;
-        if (!cu_data) cu_data=&cu_data_local; // allow caller to not care
+typedef CU_DATA *(*CU_OP)(int cu); // CU_DATA to read the cu'th unit's header into, or NULL to skip the unit
+
+// walk filename's units, handing each to op; with "next", a unit is only walked once claimed from it
+static int traverse_units(char *filename,DIE_OP op,CU_OP cu_op,DIEWALK_FLAGS flags,int *next)
+{
+    int read_cu_list(Dwarf_Debug dbg) {
+        int status=0;
+        Dwarf_Error error=0;
+        CU_DATA header,*cu_data=NULL;
         Dwarf_Die die;
+        int cu=0,claim=next?__atomic_fetch_add(next,1,__ATOMIC_RELAXED):0;
 
-        while (1) {
+        for (;;cu++) {
             TRY(dwarf_next_cu_header_d(dbg,
                                        (flags&RDW_is_info)!=0,
-                                       &cu_data->header_length,
-                                       &cu_data->version_stamp,
-                                       &cu_data->abbrev_offset,
-                                       &cu_data->address_size,
-                                       &cu_data->length_size,
-                                       &cu_data->extension_size,
-                                       &cu_data->sig8,
-                                       &cu_data->offset,
-                                       &cu_data->next_cu_header_offset,
-                                       &cu_data->header_cu_type,
+                                       &header.header_length,
+                                       &header.version_stamp,
+                                       &header.abbrev_offset,
+                                       &header.address_size,
+                                       &header.length_size,
+                                       &header.extension_size,
+                                       &header.sig8,
+                                       &header.offset,
+                                       &header.next_cu_header_offset,
+                                       &header.header_cu_type,
                                        &error),
                 "read next cu header");
-            DWARF_ID(cu_data->next_cu_header_offset_str,cu_data->next_cu_header_offset);
             CATCH(status==DW_DLV_NO_ENTRY,0,goto done,"check for no next cu header");
             CATCH(status!=DW_DLV_OK,status,goto done,"check error dwarf_next_cu_header");
+            if (next) {
+                if (cu!=claim)
+                    continue; // another worker's
+                claim=__atomic_fetch_add(next,1,__ATOMIC_RELAXED);
+            }
+            if (!(cu_data=cu_op(cu)))
+                continue;
+            *cu_data=header;
+            DWARF_ID(cu_data->next_cu_header_offset_str,cu_data->next_cu_header_offset);
 
-            static char alias[32];
+            char alias[32];
             DWARF_ALIAS(alias,cu_data->sig8);
             DEBUG(fprintf(stdout,CODE_BLUE "Read a CU header, offset 0x%x sig8 %s cu_type %s" CODE_RESET "\n",
                           cu_data->offset,alias,DW_IDX_STRING[cu_data->header_cu_type]));
@@ -206,21 +242,107 @@ int traverse_cus(char *filename,DIE_OP op,CU_DATA *cu_data,DIEWALK_FLAGS flags)
         return status;
     }
 
+    return dwarf_session(filename,read_cu_list);
+}
+
+// walk just the compile unit whose CU die is at cu_offset (see cif_materialize); libdwarf seeks to it
+static int traverse_unit_at(char *filename,DIE_OP op,CU_OP cu_op,Dwarf_Off cu_offset)
+{
+    int read_cu(Dwarf_Debug dbg) {
+        int status=0;
+        Dwarf_Error error=0;
+        Dwarf_Die die=0;
+        Dwarf_Half version=0,offset_size=0,address_size=0,extension_size=0;
+        Dwarf_Bool is_info=0,is_dwo=0;
+        Dwarf_Sig8 *sig8=NULL;
+        Dwarf_Off length_offset=0;
+        Dwarf_Unsigned length=0;
+        CU_DATA *cu_data=NULL;
+        STRY(dwarf_offdie_b(dbg,cu_offset,true,&die,&error)!=DW_DLV_OK,"seek cu die at 0x%llx",(unsigned long long) cu_offset);
+        TRYCATCH(dwarf_cu_header_basics(die,&version,&is_info,&is_dwo,&offset_size,&address_size,&extension_size,&sig8,&length_offset,&length,&error)!=DW_DLV_OK,
+                 status,release_die,"read cu header");
+        if ((cu_data=cu_op(0))) {
+            ZERO(*cu_data);
+            cu_data->version_stamp=version;
+            cu_data->address_size=address_size;
+            cu_data->length_size=offset_size;
+            cu_data->extension_size=extension_size;
+            if (sig8)
+                cu_data->sig8=*sig8;
+            cu_data->next_cu_header_offset=length_offset+length;
+            cu_data->header_cu_type=DW_UT_compile;
+            DWARF_ID(cu_data->next_cu_header_offset_str,cu_data->next_cu_header_offset);
+            status=op(dbg,die,RDW_is_info);
+        }
+    release_die:
+        dwarf_dealloc(dbg,die,DW_DLA_DIE);
+    done:
+        return status;
+    }
+
+    return dwarf_session(filename,read_cu);
+}
+
+static LTV *debug_filename(char *filename)
+{
     LTV *debug_link_filename=get_separated_debug_filename(filename);
-    if (debug_link_filename) {
+    if (debug_link_filename)
         fprintf(stderr,"Using alt debug filename %s for %s\n",(char *) debug_link_filename->data,filename);
-        filename=(char *) debug_link_filename->data;
+    return debug_link_filename;
+}
+
+int traverse_cus(char *filename,DIE_OP op,CU_DATA *cu_data,DIEWALK_FLAGS flags)
+{
+    CU_DATA cu_data_local;
+    CU_DATA *each_cu(int cu) { return cu_data?cu_data:&cu_data_local; } // allow caller to not care
+    LTV *debug_link_filename=debug_filename(filename);
+    int status=traverse_units(debug_link_filename?(char *) debug_link_filename->data:filename,op,each_cu,flags,NULL);
+    LTV_release(debug_link_filename);
+    return status;
+}
+
+// A module's BTF (.BTF: the compact type format GCC emits with -gbtf), when it's to be curated
+// instead of DWARF: if J2_BTF is set, or if there's no DWARF to be had.
+static LTV *cif_btf(char *filename)
+{
+    LTV *btf=get_elf_section(filename,".BTF"),*debug_link_filename=NULL;
+    int has_dwarf(Dwarf_Debug dbg) { return 0; }
+    if (btf && !getenv("J2_BTF")) {
+        debug_link_filename=debug_filename(filename);
+        if (!dwarf_session(debug_link_filename?(char *) debug_link_filename->data:filename,has_dwarf)) {
+            LTV_release(btf);
+            btf=NULL;
+        }
+        LTV_release(debug_link_filename);
     }
+    return btf;
+}
 
-    int filedesc = -1;
-    STRY((filedesc=open(filename,O_RDONLY))<0,"open dwarf2edict input file %s",filename);
-    TRYCATCH(dwarf_init(filedesc,DW_DLC_READ,NULL,NULL,&dbg,&error),status,close_file,"initialize dwarf reader");
-    TRYCATCH(read_cu_list(),status,close_dwarf,"read cu list");
- close_dwarf:
-    STRY(dwarf_finish(dbg,&error),"finalize dwarf reader");
- close_file:
-    close(filedesc);
- done:
+// traverse_cus, with units dealt out to up to "threads" workers, each reading through its own Dwarf_Debug.
+// cu_op runs on the claiming worker, so per-unit state belongs in whatever CU_DATA it hands back.
+int traverse_cus_parallel(char *filename,DIE_OP op,CU_OP cu_op,int threads,DIEWALK_FLAGS flags)
+{
+    int status=0,next=0,spawned=0,concurrent=LT_CONCURRENT;
+    pthread_t worker[threads];
+    int result[threads];
+    LTV *debug_link_filename=debug_filename(filename);
+    if (debug_link_filename)
+        filename=(char *) debug_link_filename->data;
+
+    void *work(void *arg) { *(int *) arg=traverse_units(filename,op,cu_op,flags,&next); return NULL; }
+
+    if (threads>1) {
+        concurrent=lt_concurrent_enter(false); // workers read the module's trees; joined below
+        while (spawned<threads && !pthread_create(&worker[spawned],NULL,work,&result[spawned]))
+            spawned++;
+    }
+    if (!spawned) // no threads to be had; walk every unit here
+        status=traverse_units(filename,op,cu_op,flags,NULL);
+    for (int i=0;i<spawned;i++) { // work runs on this frame, so always join before leaving
+        pthread_join(worker[i],NULL);
+        status=status?status:result[i];
+    }
+    lt_concurrent_restore(concurrent); // workers are gone; back to whatever the caller had
     LTV_release(debug_link_filename);
     return status;
 }
@@ -272,7 +394,7 @@ int print_type_info(FILE *ofile,LTV *ltv)
 
     fprintf(ofile, "|TYPE_INFO %s", type_info->id_str);
     const char *str=NULL;
-    static char alias[32];
+    char alias[32];
     DWARF_ALIAS(alias,type_info->sig8);
     dwarf_get_TAG_name(type_info->tag,&str);
     fprintf(ofile,"|%s",str+7);
@@ -505,7 +627,9 @@ LTV *cif_assign_cvar(LTV *dst,LTV *src)
     LTV *type=NULL;
     TYPE_UVALUE dst_uval={},src_uval={};
     STRY(!Type_getUVAL(dst,&dst_uval),"test cvar dest compatibility");
-    if (Type_getUVAL(src,&src_uval))
+    if (src->flags&LT_NUM)
+        Type_putUVAL(dst,Type_immUVAL(&dst_uval,src));
+    else if (Type_getUVAL(src,&src_uval))
         Type_putUVAL(dst,&src_uval);
     else
         Type_putUVAL(dst,Type_pullUVAL(&dst_uval,src->data));
@@ -1088,17 +1212,577 @@ int cif_dump_module(char *ofilename,LTV *module)
 
 extern void dump_macros(Dwarf_Debug dbg, Dwarf_Die cu_die);
 
-extern int cif_import_module(LTV *module) { return cif_curate_module(module,0); }
+extern int cif_import_module(LTV *module) { return cif_cache_load(module,0)?cif_curate_module(module,0,0):0; }
+
+// bind a dlsym'ed function/variable into module under name; bindings (if any) remembers how, for the cache
+static LTV *cif_bind(LTV *module,LTV *bindings,void *dlhandle,char *name,char *symbol,LTV *type)
+{
+    LTV *cvar=NULL;
+    void *addr=NULL;
+    dlerror(); // reset
+    if ((addr=dlsym(dlhandle,symbol)) && (cvar=cif_create_cvar(type,addr,NULL))) {
+        LT_put(module,name,HEAD,cvar); // ahead of any other CU's lazy placeholders
+        if (bindings)
+            LT_put(LT_put(bindings,name,TAIL,LTV_init(NEW(LTV),symbol,-1,LT_DUP)),TYPE_BASE,HEAD,type);
+    }
+    else
+        DEBUG(fprintf(stderr,"dlsym error: handle %x %s (%s)\n",dlhandle,dlerror(),name));
+    return cvar;
+}
+
+/////////////////////////////////////////////////////////////
+//
+// Lazy import: index the names each compile unit's top-level dies would install,
+// as LT_LAZY placeholders holding the CU's offset, and curate a CU only when
+// one of its names is first looked up (listree calls LTV_lazy). The names come from the
+// module's accelerator tables when it has them, so neither step depends on module size.
+// Glob refs materialize the placeholders they match too; structural walks (LTI_first/LTI_iter)
+// see them as-is.
+//
+/////////////////////////////////////////////////////////////
+
+static __thread int cif_curating=0; // this thread is materializing; its own lookups see placeholders as-is
+static pthread_mutex_t cif_curate_mutex=PTHREAD_MUTEX_INITIALIZER;
+
+static void cif_unlazy(LTV *module,char *name,Dwarf_Off cu_offset) // drop name's placeholders for a CU ((Dwarf_Off) -1: any)
+{
+    void *drop(CLL *lnk) {
+        LTV *ltv=((LTVR *) lnk)->ltv;
+        if ((ltv->flags&LT_LAZY) && (cu_offset==(Dwarf_Off) -1 || (Dwarf_Off) ltv->data==cu_offset))
+            LTVR_release(lnk);
+        return NULL;
+    }
+    LTI *lti=LTI_resolve(module,name,false);
+    if (lti)
+        CLL_map(&lti->ltvs,FWD,drop);
+}
+
+static LTV *cif_bound(LTV *module,char *name) // what name is bound to; other CUs' placeholders don't count
+{
+    LTV *ltv=LT_get(module,name,HEAD,KEEP);
+    return ltv && (ltv->flags&LT_LAZY)?NULL:ltv;
+}
 
-int cif_curate_module(LTV *module,int bootstrap)
+static LTI *cif_materialize(LTV *module,LTI *lti)
+{
+    LTV *placeholder=LTV_peek(&lti->ltvs,HEAD);
+    if (cif_curating || !placeholder || !(placeholder->flags&LT_LAZY))
+        return lti;
+    pthread_mutex_lock(&cif_curate_mutex);
+    cif_curating=1;
+    // not beaten to it; if curating the placeholder's CU didn't bind the name, move on to the next one's
+    while ((placeholder=LTV_peek(&lti->ltvs,HEAD)) && (placeholder->flags&LT_LAZY)) {
+        Dwarf_Off cu_offset=(Dwarf_Off) placeholder->data;
+        char cu[TYPE_IDLEN];
+        DWARF_ID(cu,cu_offset);
+        LTV *pending=LT_get(module,MODULE_LAZY,HEAD,KEEP);
+        LTV *names=pending?LT_get(pending,cu,HEAD,POP):NULL;
+        attr_del(pending,cu);
+        void *unlazy(LTV *name) { cif_unlazy(module,name->data,cu_offset); return NULL; }
+        if (names) // clear the way for this CU's own entries (curation won't bind over a name that's taken)
+            LTV_each(LTV_list(names),FWD,unlazy);
+        cif_unlazy(module,lti->name,cu_offset);
+        LTV_release(names);
+        cif_curate_module(module,0,cu_offset);
+        if (pending && !LTI_first(pending)) { // fully curated
+            attr_del(module,MODULE_LAZY);
+            module->flags&=~LT_LAZY;
+        }
+    }
+    cif_curating=0;
+    pthread_mutex_unlock(&cif_curate_mutex);
+    return lti;
+}
+
+extern int cif_lazy_import_module(LTV *module)
 {
     int status=0;
     CU_DATA cu_data;
+    LTV *pending=NULL,*debug_link_filename=NULL,*btf=NULL;
+    char *filename=PRINTA(filename,module->len,module->data);
+    Dwarf_Off cu_offset=0; // of the CU whose names are being indexed
+    LTV *names=NULL;       // ...and where they're listed
+    int indexed=0;
+
+    int index_name(char *symb) {
+        int status=0;
+        LTI *lti=LTI_resolve(module,symb,false);
+        LTV *last=lti?LTV_peek(&lti->ltvs,TAIL):NULL;
+        if (last && (last->flags&LT_LAZY) && (Dwarf_Off) last->data==cu_offset)
+            goto done; // accelerator tables can name a die more than once
+        STRY(!LT_put(module,symb,TAIL,LTV_init(NEW(LTV),(void *) cu_offset,0,LT_IMM|LT_LAZY)),"index %s",symb);
+        LTV_enq(LTV_list(names),LTV_init(NEW(LTV),symb,-1,LT_DUP),TAIL);
+        indexed++;
+    done:
+        return status;
+    };
+
+    void reset() { // forget a partial index
+        for (LTI *lti=LTI_first(pending);lti;lti=LTI_iter(pending,lti,FWD)) {
+            void *unlazy(LTV *name) { cif_unlazy(module,name->data,(Dwarf_Off) -1); return NULL; }
+            LTV_each(LTV_list(LTV_peek(&lti->ltvs,HEAD)),FWD,unlazy);
+        }
+        attr_del(module,MODULE_LAZY);
+        pending=LT_put(module,MODULE_LAZY,HEAD,LTV_NULL_HASH);
+        indexed=0;
+    };
+
+    int cu_names(Dwarf_Off offset) { // select the CU that index_name lists names for
+        int status=0;
+        char cu[TYPE_IDLEN];
+        DWARF_ID(cu,cu_offset=offset);
+        if (!(names=LT_get(pending,cu,HEAD,KEEP)))
+            STRY(!(names=LT_put(pending,cu,TAIL,LTV_NULL_LIST)),"list compile unit names");
+    done:
+        return status;
+    };
+
+    int name_op(Dwarf_Debug dbg,Dwarf_Die die,DIEWALK_FLAGS flags) {
+        int status=0;
+        Dwarf_Error error=0;
+        Dwarf_Half tag;
+        Dwarf_Bool decl=0;
+        char *name=NULL,*symb=NULL,*prefix=NULL;
+        STRY(dwarf_tag(die,&tag,&error),"get die tag");
+        switch (tag) { // see derive_symbolic_name
+            case DW_TAG_structure_type:   prefix="struct "; break;
+            case DW_TAG_class_type:       prefix="class ";  break;
+            case DW_TAG_union_type:       prefix="union ";  break;
+            case DW_TAG_enumeration_type: prefix="enum ";
+                STRY(traverse_child(dbg,die,name_op,flags|RDW_traverse_sibs),"index enumerators");
+                break;
+            case DW_TAG_subprogram:
+            case DW_TAG_variable:
+            case DW_TAG_typedef:
+            case DW_TAG_base_type:
+            case DW_TAG_enumerator:       prefix="";        break;
+            default: goto done;
+        }
+        if (prefix[0] && dwarf_hasattr(die,DW_AT_declaration,&decl,&error)==DW_DLV_OK && decl)
+            goto done; // only a definition should stand for a type
+        if ((name=get_diename(dbg,die))) {
+            CONCATA(symb,prefix,name);
+            DELETE(name);
+            STRY(index_name(symb),"index die name");
+        }
+    done:
+        return status;
+    };
+
+    int op(Dwarf_Debug dbg,Dwarf_Die die,DIEWALK_FLAGS flags) {
+        int status=0;
+        Dwarf_Error error=0;
+        Dwarf_Off offset;
+        STRY(dwarf_CU_dieoffset_given_die(die,&offset,&error),"get compile unit offset");
+        STRY(cu_names(offset),"select compile unit");
+        STRY(traverse_child(dbg,die,name_op,flags|RDW_traverse_sibs),"index compile unit");
+    done:
+        return status;
+    };
+
+    // .debug_pubnames/.debug_pubtypes (and .debug_names, where libdwarf folds it into the globals) point
+    // straight at each name's die, so it's read in place of walking every CU's dies.
+    int pub_index(Dwarf_Debug dbg) {
+        int status=0;
+        Dwarf_Error error=0;
+        Dwarf_Global *globals=NULL;
+        Dwarf_Type *types=NULL;
+        Dwarf_Signed nglobals=0,ntypes=0;
+        int typed=0;
+
+        int index_die(Dwarf_Off die_offset) { // best effort; an entry that doesn't resolve is skipped
+            Dwarf_Die die=0;
+            Dwarf_Off offset;
+            Dwarf_Half tag;
+            if (dwarf_offdie_b(dbg,die_offset,true,&die,&error)!=DW_DLV_OK)
+                return 0;
+            if (dwarf_CU_dieoffset_given_die(die,&offset,&error)==DW_DLV_OK && !cu_names(offset)) {
+                if (dwarf_tag(die,&tag,&error)==DW_DLV_OK && tag!=DW_TAG_subprogram && tag!=DW_TAG_variable && tag!=DW_TAG_enumerator)
+                    typed=1;
+                name_op(dbg,die,RDW_is_info);
+            }
+            dwarf_dealloc(dbg,die,DW_DLA_DIE);
+            return 0;
+        };
+
+        if (dwarf_get_globals(dbg,&globals,&nglobals,&error)!=DW_DLV_OK)
+            goto done;
+        if (dwarf_get_pubtypes(dbg,&types,&ntypes,&error)==DW_DLV_OK) {
+            Dwarf_Off die_offset;
+            for (int i=0;i<ntypes;i++)
+                if (dwarf_pubtype_die_offset(types[i],&die_offset,&error)==DW_DLV_OK)
+                    index_die(die_offset);
+            dwarf_pubtypes_dealloc(dbg,types,ntypes);
+        }
+        for (int i=0;i<nglobals;i++) {
+            Dwarf_Off die_offset;
+            if (dwarf_global_die_offset(globals[i],&die_offset,&error)==DW_DLV_OK)
+                index_die(die_offset);
+        }
+        dwarf_globals_dealloc(dbg,globals,nglobals);
+        if (!ntypes && !typed) // functions and variables alone won't find types; walk instead
+            indexed=0;
+    done:
+        return status;
+    };
+
+    // .gdb_index names each symbol's CUs, but not its die; a type could be any kind, so it's listed under
+    // every name derive_symbolic_name might give it, and the misses are dropped when its CU is curated.
+    int gdb_index(Dwarf_Debug dbg) {
+        int status=0;
+        Dwarf_Error error=0;
+        Dwarf_Gdbindex gdbindex=0;
+        Dwarf_Unsigned version,cu_list_offset,types_cu_list_offset,address_area_offset,symbol_table_offset;
+        Dwarf_Unsigned constant_pool_offset,section_size,reserved,ncus=0,nsymbols=0;
+        const char *section_name=NULL;
+        static char *type_prefix[]={"","struct ","union ","enum ","class ",NULL};
+        int index_type(char *prefix,char *name) { char *symb=NULL; return index_name(CONCATA(symb,prefix,name)); } // alloca freed on return
+
+        if (dwarf_gdbindex_header(dbg,&gdbindex,&version,&cu_list_offset,&types_cu_list_offset,&address_area_offset,
+                                  &symbol_table_offset,&constant_pool_offset,&section_size,&reserved,&section_name,&error)!=DW_DLV_OK)
+            goto done;
+        STRY(dwarf_gdbindex_culist_array(gdbindex,&ncus,&error)!=DW_DLV_OK,"read .gdb_index cu list");
+        STRY(dwarf_gdbindex_symboltable_array(gdbindex,&nsymbols,&error)!=DW_DLV_OK,"read .gdb_index symbol table");
+        for (Dwarf_Unsigned i=0;i<nsymbols;i++) {
+            Dwarf_Unsigned string_offset,cu_vector_offset,ncuvec=0;
+            const char *name=NULL;
+            if (dwarf_gdbindex_symboltable_entry(gdbindex,i,&string_offset,&cu_vector_offset,&error)!=DW_DLV_OK ||
+                (!string_offset && !cu_vector_offset) ||
+                dwarf_gdbindex_string_by_offset(gdbindex,string_offset,&name,&error)!=DW_DLV_OK ||
+                dwarf_gdbindex_cuvector_length(gdbindex,cu_vector_offset,&ncuvec,&error)!=DW_DLV_OK)
+                continue; // empty slot
+            for (Dwarf_Unsigned j=0;j<ncuvec;j++) {
+                Dwarf_Unsigned attributes,cu_index,reserved1,kind,is_static,cu_header,cu_length;
+                Dwarf_Off offset;
+                if (dwarf_gdbindex_cuvector_inner_attributes(gdbindex,cu_vector_offset,j,&attributes,&error)!=DW_DLV_OK ||
+                    dwarf_gdbindex_cuvector_instance_expand_value(gdbindex,attributes,&cu_index,&reserved1,&kind,&is_static,&error)!=DW_DLV_OK ||
+                    cu_index>=ncus || // a type unit's; those are reached through the CUs that use them
+                    dwarf_gdbindex_culist_entry(gdbindex,cu_index,&cu_header,&cu_length,&error)!=DW_DLV_OK ||
+                    dwarf_get_cu_die_offset_given_cu_header_offset_b(dbg,cu_header,true,&offset,&error)!=DW_DLV_OK ||
+                    cu_names(offset))
+                    continue;
+                switch (kind) {
+                    case 1: // type
+                        for (int k=0;type_prefix[k];k++)
+                            STRY(index_type(type_prefix[k],(char *) name),"index type name");
+                        break;
+                    case 2: // variable (or enumerator)
+                    case 3: // function
+                        STRY(index_name((char *) name),"index name");
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    done:
+        if (gdbindex)
+            dwarf_gdbindex_free(gdbindex);
+        return status;
+    };
+
+    if (!cif_cache_load(module,0)) // mapping a complete curation is cheaper still
+        goto done;
+    if ((btf=cif_btf(filename))) { // as is curating BTF outright
+        LTV_release(btf);
+        return cif_curate_module(module,0,0);
+    }
+    LTV_lazy=cif_materialize;
+    STRY(!(pending=LT_put(module,MODULE_LAZY,HEAD,LTV_NULL_HASH)),"create lazy index");
+    debug_link_filename=debug_filename(filename);
+    if (debug_link_filename)
+        filename=(char *) debug_link_filename->data;
+    if (dwarf_session(filename,pub_index) || !indexed) {
+        reset();
+        if (dwarf_session(filename,gdb_index))
+            reset();
+    }
+    if (!indexed) { // no accelerator tables; visit every CU's top-level dies
+        CU_DATA *each_cu(int cu) { return &cu_data; }
+        STRY(!pending,"create lazy index");
+        STRY(traverse_units(filename,op,each_cu,RDW_is_info,NULL),"index compile units");
+    }
+    module->flags|=LT_LAZY;
+ done:
+    LTV_release(debug_link_filename);
+    return status;
+}
+
+/////////////////////////////////////////////////////////////
+//
+// Curation cache: a curated module is saved as a listree image (see image_ltv_to_file),
+// named for the build-ids of the module and of this library, and mapped on later loads
+// instead of walking the DWARF again. Function/variable cvars hold this process's
+// addresses, so they're saved as symbol/type bindings and re-resolved with dlsym.
+//
+/////////////////////////////////////////////////////////////
+
+static LTV *cif_cache_path(char *filename)
+{
+    LTV *path=NULL,*module_id=NULL,*curator_id=NULL;
+    char *dir=getenv("J2_CACHE"),*home=getenv("HOME"),*buf=NULL;
+    Dl_info dl_info;
+    if (!dir && home) { // $HOME/.cache/j2
+        mkdir(CONCATA(dir,home,"/.cache"),0755);
+        dir=CONCATA(buf,dir,"/j2");
+    }
+    if (dir && dladdr((void *) cif_init,&dl_info) &&
+        (module_id=get_build_id(filename)) && (curator_id=get_build_id((char *) dl_info.dli_fname))) {
+        mkdir(dir,0755); // may already exist
+        path=LTV_init(NEW(LTV),FORMATA(buf,strlen(dir)+module_id->len+curator_id->len,"%s/%s-%s.lt",dir,module_id->data,curator_id->data),-1,LT_DUP);
+    }
+    LTV_release(module_id);
+    LTV_release(curator_id);
+    return path;
+}
+
+// restore module's curated contents from the cache; nonzero (quietly) if there's nothing usable cached
+static int cif_cache_load(LTV *module,int bootstrap)
+{
+    int status=0,n=0;
+    LTV *path=NULL,*cache=NULL,*cached=NULL,*bindings=NULL;
+    LT_BULK *pairs=NULL;
+    char *filename=PRINTA(filename,module->len,module->data);
+
+    if (!(path=cif_cache_path(filename)) || access(path->data,R_OK)) {
+        status=1;
+        goto done;
+    }
+    STRY(!(cache=image_ltv_map(path->data)),"map reflection cache %s",path->data);
+    STRY(!(cached=LT_get(cache,"module",HEAD,KEEP)),"find cached module in %s",path->data);
+
+    for (LTI *lti=LTI_first(cached);lti;lti=LTI_iter(cached,lti,FWD))
+        n+=CLL_len(&lti->ltvs);
+    STRY(!(pairs=(LT_BULK *) mymalloc(MAX(n,1)*sizeof(LT_BULK))),"allocate cached module entries");
+    n=0;
+    for (LTI *lti=LTI_first(cached);lti;lti=LTI_iter(cached,lti,FWD)) {
+        void *pair(LTV *ltv) { pairs[n++]=(LT_BULK) {lti->name,lti->len,ltv}; return NULL; }
+        LTV_each(&lti->ltvs,FWD,pair);
+    }
+    for (LTI *lti=NULL;(lti=LTI_first(module));) // the cache includes the preview, so start clean
+        LTV_erase(module,lti);
+    STRY(LTV_bulk(module,pairs,n,LT_BULK_SORTED)<0,"install cached module entries");
+
+    if ((bindings=LT_get(cache,"bindings",HEAD,KEEP))) {
+        void *dlhandle=dlopen(bootstrap?NULL:filename,RTLD_LAZY | RTLD_GLOBAL | RTLD_NODELETE | RTLD_DEEPBIND);
+        if (!dlhandle)
+            fprintf(stderr,"failed to dlopen %s; continuing without resolving global functions/variables\n",dlerror());
+        for (LTI *lti=LTI_first(bindings);dlhandle && lti;lti=LTI_iter(bindings,lti,FWD)) {
+            void *bind(LTV *binding) { cif_bind(module,NULL,dlhandle,lti->name,binding->data,LT_get(binding,TYPE_BASE,HEAD,KEEP)); return NULL; }
+            LTV_each(&lti->ltvs,FWD,bind);
+        }
+        if (dlhandle)
+            dlclose(dlhandle);
+    }
+    fprintf(stderr,"Loaded curated module from %s\n",(char *) path->data);
+ done:
+    DELETE(pairs);
+    LTV_release(path);
+    return status;
+}
+
+static int cif_cache_save(LTV *module,LTV *cache)
+{
+    int status=0;
+    LTV *path=NULL;
+    char *filename=PRINTA(filename,module->len,module->data),*tmp=NULL;
+
+    if (!(path=cif_cache_path(filename)))
+        goto done;
+    STRY(!LT_put(cache,"module",HEAD,module),"add module to reflection cache");
+    FORMATA(tmp,path->len+16,"%s.%d",(char *) path->data,getpid()); // whole file or nothing, even with racing writers
+    STRY(image_ltv_to_file(tmp,cache),"write reflection cache %s",tmp);
+    TRYCATCH(rename(tmp,path->data),TRY_ERR,cleanup,"install reflection cache %s",(char *) path->data);
+    goto done;
+ cleanup:
+    unlink(tmp);
+ done:
+    LTV_release(path);
+    return status;
+}
+
+// One unit's curation, done apart from the others' (see traverse_cus_parallel) and merged in unit order.
+typedef struct {
+    CU_DATA cu_data;
+    LTV *type_ltvs,*index[2],*aliases,*links; // the unit's share of cif_curate_module's gc list, indices, and module
+    LT_BULK *defines;
+    int ndefines;
+} CU_UNIT;
+
+static __thread CU_UNIT *cu_unit=NULL; // the unit this thread is curating
+
+static CU_UNIT *cu_unit_new()
+{
+    CU_UNIT *unit=NEW(CU_UNIT);
+    unit->type_ltvs=LTV_NULL_LIST;
+    unit->index[0]=LTV_NULL_HASH;
+    unit->index[1]=LTV_NULL_HASH;
+    unit->aliases=LTV_NULL_HASH;
+    unit->links=LTV_NULL_HASH;
+    return unit;
+}
+
+static void cu_unit_free(CU_UNIT *unit)
+{
+    if (!unit)
+        return;
+    LTV_release(unit->links);
+    LTV_release(unit->aliases);
+    LTV_release(unit->index[1]);
+    LTV_release(unit->index[0]);
+    LTV_release(unit->type_ltvs);
+    for (int i=0;i<unit->ndefines;i++) {
+        DELETE(unit->defines[i].name);
+        LTV_release(unit->defines[i].ltv);
+    }
+    DELETE(unit->defines);
+    DELETE(unit);
+}
+
+// add each of src's values to dst under the same name, after any dst already has
+static void merge_dict(LTV *dst,LTV *src)
+{
+    for (LTI *lti=LTI_first(src);lti;lti=LTI_iter(src,lti,FWD)) {
+        void *merge(LTV *ltv) { LT_put(dst,lti->name,TAIL,ltv); return NULL; }
+        LTV_each(&lti->ltvs,FWD,merge);
+    }
+}
+
+static int cif_threads=0; // overrides J2_THREADS when set (see cif_import_verify)
+
+static int cif_curate_threads() // J2_THREADS, or one per cpu
+{
+    char *threads=getenv("J2_THREADS");
+    if (cif_threads)
+        return cif_threads;
+    int n=threads?atoi(threads):sysconf(_SC_NPROCESSORS_ONLN);
+    return MAX(1,MIN(n,16));
+}
+
+// Curation-local index of what each symbolic name resolves to at the module's head, so dedup doesn't
+// intern and look up every derived name in the module. Names the index hasn't seen fall back to the module.
+typedef struct SYMB_ENTRY {
+    struct SYMB_ENTRY *next;
+    unsigned hash;
+    int category; // tag category (see symb_category); subprograms and subroutine types share one
+    TYPE_INFO_LTV *type_info;
+    int len;
+    char name[];
+} SYMB_ENTRY;
+
+typedef struct {
+    SYMB_ENTRY **bucket;
+    unsigned buckets,count;
+    char *buf; // reusable buffer for names being derived
+    int size,len;
+} SYMB_INDEX;
+
+static int symb_category(TYPE_INFO_LTV *type_info)
+{
+    switch (type_info->tag) {
+        case DW_TAG_subprogram: case DW_TAG_subroutine_type: return (int) DW_TAG_subprogram;
+        default: return (int) type_info->tag;
+    }
+}
+
+static char *symb_printf(SYMB_INDEX *index,int append,char *format,...) // (re)build a name in index->buf
+{
+    va_list args;
+    if (!append) index->len=0;
+    for (;;) {
+        va_start(args,format);
+        int len=vsnprintf(index->buf+index->len,index->size-index->len,format,args);
+        va_end(args);
+        if (len<0) return NULL;
+        if (index->len+len<index->size) { index->len+=len; return index->buf; }
+        char *buf=RENEW(index->buf,(index->len+len+1)*2);
+        if (!buf) return NULL;
+        index->buf=buf;
+        index->size=(index->len+len+1)*2;
+    }
+}
+
+static SYMB_ENTRY **symb_find(SYMB_INDEX *index,char *name,int len,unsigned hash)
+{
+    SYMB_ENTRY **link=&index->bucket[hash&(index->buckets-1)];
+    while (*link && !((*link)->hash==hash && (*link)->len==len && !memcmp((*link)->name,name,len)))
+        link=&(*link)->next;
+    return link;
+}
+
+static TYPE_INFO_LTV *symb_put(SYMB_INDEX *index,char *name,TYPE_INFO_LTV *type_info)
+{
+    int len=strlen(name);
+    unsigned hash=strnhash(name,len);
+    if (index->count>=index->buckets) { // grow
+        unsigned buckets=index->buckets?index->buckets*2:4096;
+        SYMB_ENTRY **bucket=(SYMB_ENTRY **) mymalloc(buckets*sizeof(SYMB_ENTRY *));
+        if (!bucket)
+            return NULL;
+        for (unsigned i=0;i<index->buckets;i++) {
+            for (SYMB_ENTRY *next,*entry=index->bucket[i];entry;entry=next) {
+                next=entry->next;
+                entry->next=bucket[entry->hash&(buckets-1)];
+                bucket[entry->hash&(buckets-1)]=entry;
+            }
+        }
+        DELETE(index->bucket);
+        index->bucket=bucket;
+        index->buckets=buckets;
+    }
+    SYMB_ENTRY **link=symb_find(index,name,len,hash);
+    if (!*link) {
+        if (!(*link=(SYMB_ENTRY *) mymalloc(sizeof(SYMB_ENTRY)+len+1)))
+            return NULL;
+        (*link)->hash=hash;
+        (*link)->len=len;
+        memcpy((*link)->name,name,len);
+        index->count++;
+    }
+    (*link)->type_info=type_info;
+    (*link)->category=symb_category(type_info);
+    return type_info;
+}
+
+static TYPE_INFO_LTV *symb_get(SYMB_INDEX *index,LTV *module,char *name,int *category)
+{
+    if (index->buckets) {
+        int len=strlen(name);
+        SYMB_ENTRY *entry=*symb_find(index,name,len,strnhash(name,len));
+        if (entry) {
+            if (category) *category=entry->category;
+            return entry->type_info;
+        }
+    }
+    LTV *ltv=LT_get(module,name,HEAD,KEEP);
+    if (!ltv || !(ltv->flags&LT_TYPE)) // not a type (yet); don't remember it
+        return NULL;
+    if (category) *category=symb_category((TYPE_INFO_LTV *) ltv);
+    return symb_put(index,name,(TYPE_INFO_LTV *) ltv)?:(TYPE_INFO_LTV *) ltv;
+}
+
+static void symb_free(SYMB_INDEX *index)
+{
+    for (unsigned i=0;i<index->buckets;i++)
+        for (SYMB_ENTRY *next,*entry=index->bucket[i];entry;entry=next) {
+            next=entry->next;
+            DELETE(entry);
+        }
+    DELETE(index->bucket);
+    DELETE(index->buf);
+    ZERO(*index);
+}
+
+int cif_curate_module(LTV *module,int bootstrap,Dwarf_Off only_cu) // only_cu: curate just that compile unit (see cif_materialize)
+{
+    int status=0;
 
     LTV *type_ltvs=LTV_NULL_LIST;
-    LTV *index[]={ LTV_NULL,LTV_NULL }; // type_units, compile_units
-    LTV *aliases=LTV_NULL;
+    LTV *index[]={ LTV_NULL_HASH,LTV_NULL_HASH }; // type_units, compile_units
+    LTV *aliases=LTV_NULL_HASH;
+    LTV *cache=LTV_NULL,*bindings=LT_put(cache,"bindings",HEAD,LTV_NULL_HASH); // see cif_cache_save
     void *dlhandle=NULL;
+    SYMB_INDEX symbs={}; // see symb_get
 
     int derive_symbolic_name(TYPE_INFO_LTV *type_info,int post) {
         int status=0;
@@ -1113,11 +1797,10 @@ int cif_curate_module(LTV *module,int bootstrap)
 
         char *type_name=attr_get(&type_info->ltv,TYPE_NAME);
         char *base_symb=base_info && (base_info->flags&TYPEF_SYMBOLIC)? attr_get(&base_info->ltv,TYPE_SYMB):NULL;
-        char *composite_name=NULL;
 
         void dedup_base(void) {
             if (base_info && base_symb) { // dedup types; to get here, base must have already been categorized
-                TYPE_INFO_LTV *symb_base=(TYPE_INFO_LTV *) LT_get(module,base_symb,HEAD,KEEP);
+                TYPE_INFO_LTV *symb_base=symb_get(&symbs,module,base_symb,NULL);
                 if (symb_base && symb_base!=base_info) { // may already be correct
                     attr_del(&type_info->ltv,TYPE_BASE);
                     LT_put(&type_info->ltv,TYPE_BASE,TAIL,&symb_base->ltv);
@@ -1130,23 +1813,16 @@ int cif_curate_module(LTV *module,int bootstrap)
         };
 
         TYPE_INFO_LTV *categorize_symbolic(char *sym) {
-            int tag_category(TYPE_INFO_LTV *type) {
-                switch (type->tag) {
-                    case DW_TAG_subprogram: case DW_TAG_subroutine_type: return (int) DW_TAG_subprogram;
-                    default: return (int) type->tag;
-                }
-            };
-
             TYPE_INFO_LTV *deduped=NULL;
             if (sym) {
                 type_info->flags|=TYPEF_SYMBOLIC;
                 attr_set(&type_info->ltv, TYPE_SYMB, sym);
                 const char *is;
                 dwarf_get_TAG_name(type_info->tag,&is);
-                LTV *sym_ltv=LT_get(module,sym,HEAD,KEEP); // see if symbol already exists
-                if (sym_ltv && sym_ltv->flags&LT_TYPE) {
-                    TYPE_INFO_LTV *sym_type_info=(TYPE_INFO_LTV *) sym_ltv;
-                    if (tag_category(type_info)==tag_category(sym_type_info))
+                int category=0;
+                TYPE_INFO_LTV *sym_type_info=symb_get(&symbs,module,sym,&category); // see if symbol already exists
+                if (sym_type_info) {
+                    if (symb_category(type_info)==category)
                         deduped=sym_type_info;
                     else if (type_info->tag==DW_TAG_formal_parameter)
                         deduped=sym_type_info;
@@ -1163,6 +1839,8 @@ int cif_curate_module(LTV *module,int bootstrap)
             if (!deduped) {
                 DEBUG(fprintf(stdout,"install symbolic type_info %s (%s)\n",sym,type_info->id_str));
                 LT_put(module,sym,HEAD,&type_info->ltv);
+                if (sym)
+                    symb_put(&symbs,sym,type_info);
             }
 
             return deduped?deduped:type_info;
@@ -1176,26 +1854,26 @@ int cif_curate_module(LTV *module,int bootstrap)
                 break;
             case DW_TAG_structure_type:
                 if (post && type_name)
-                    categorize_symbolic(FORMATA(composite_name,strlen(type_name),"struct %s",type_name));
+                    categorize_symbolic(symb_printf(&symbs,0,"struct %s",type_name));
                 break;
             case DW_TAG_class_type:
                 if (post && type_name)
-                    categorize_symbolic(FORMATA(composite_name,strlen(type_name),"class %s",type_name));
+                    categorize_symbolic(symb_printf(&symbs,0,"class %s",type_name));
                 break;
             case DW_TAG_union_type:
                 if (post && type_name)
-                    categorize_symbolic(FORMATA(composite_name,strlen(type_name),"union %s",type_name));
+                    categorize_symbolic(symb_printf(&symbs,0,"union %s",type_name));
                 break;
             case DW_TAG_enumeration_type:
                 if (type_name)
-                    categorize_symbolic(FORMATA(composite_name,strlen(type_name),"enum %s",type_name));
+                    categorize_symbolic(symb_printf(&symbs,0,"enum %s",type_name));
                 break;
             case DW_TAG_pointer_type:
                 if (post) {
                     if (!(type_info->flags&TYPEF_BASE))
                         base_symb="void";
                     if (base_symb)
-                        categorize_symbolic(FORMATA(composite_name,strlen(base_symb),"(%s)*",base_symb));
+                        categorize_symbolic(symb_printf(&symbs,0,"(%s)*",base_symb));
                 }
                 break;
             case DW_TAG_array_type:
@@ -1207,86 +1885,74 @@ int cif_curate_module(LTV *module,int bootstrap)
                             type_info->bytesize=base_info->bytesize * (subrange->upper_bound+1);
                             type_info->flags|=TYPEF_BYTESIZE;
                         }
-                        categorize_symbolic(FORMATA(composite_name,strlen(base_symb)+20,"(%s)[%d]",base_symb,subrange->upper_bound+1));
+                        categorize_symbolic(symb_printf(&symbs,0,"(%s)[%d]",base_symb,subrange->upper_bound+1));
                     }
                     else
-                        categorize_symbolic(FORMATA(composite_name,strlen(base_symb),"(%s)[]",base_symb));
+                        categorize_symbolic(symb_printf(&symbs,0,"(%s)[]",base_symb));
                 }
                 break;
             case DW_TAG_volatile_type:
                 if (post && base_symb)
-                    categorize_symbolic(FORMATA(composite_name,strlen(base_symb),"volatile %s",base_symb));
+                    categorize_symbolic(symb_printf(&symbs,0,"volatile %s",base_symb));
                 break;
             case DW_TAG_const_type:
                 if (post && base_symb)
-                    categorize_symbolic(FORMATA(composite_name,strlen(base_symb),"const %s",base_symb));
+                    categorize_symbolic(symb_printf(&symbs,0,"const %s",base_symb));
                 break;
             case DW_TAG_restrict_type:
                 if (post && base_symb)
-                    categorize_symbolic(FORMATA(composite_name,strlen(base_symb),"restrict %s",base_symb));
+                    categorize_symbolic(symb_printf(&symbs,0,"restrict %s",base_symb));
                 break;
             case DW_TAG_base_type:
             case DW_TAG_enumerator:
                 if (type_name)
-                    categorize_symbolic(FORMATA(composite_name,strlen(type_name),"%s",type_name));
+                    categorize_symbolic(type_name);
                 break;
             case DW_TAG_typedef:
                 if (post) {
                     if (type_name)
-                        categorize_symbolic(FORMATA(composite_name,strlen(type_name),"%s",type_name));
+                        categorize_symbolic(type_name);
                     else if (base_symb) // anonymous typedef
-                        categorize_symbolic(FORMATA(composite_name,strlen(base_symb),"%s",base_symb));
+                        categorize_symbolic(base_symb);
                 }
                 break;
             case DW_TAG_subprogram:
             case DW_TAG_subroutine_type:
                 if (post) {
-                    char signature[1024];
-                    char *bufloc=signature;
                     int count=0;
                     int marshaller(char *name,LTV *type) {
                         count++;
                         LTV *base=cif_find_symbolic(type);
-                        bufloc+=sprintf(bufloc,"%s,",attr_get(base,TYPE_SYMB));
-                        return (int) 0;
+                        return !symb_printf(&symbs,1,"%s,",attr_get(base,TYPE_SYMB));
                     };
-                    bufloc+=sprintf(bufloc,"%s(*)(",base_symb);
+                    STRY(!symb_printf(&symbs,0,"%s(*)(",base_symb),"start signature");
                     STRY(cif_args_marshal(&type_info->ltv,FWD,marshaller),"marshall ffi args"); // pre-
-                    bufloc+=sprintf(bufloc-(count?1:0),")");
-                    TYPE_INFO_LTV *cvar_type=categorize_symbolic(signature); // GLOBAL!
+                    symbs.len-=count?1:0;
+                    STRY(!symb_printf(&symbs,1,")"),"finish signature");
+                    TYPE_INFO_LTV *cvar_type=categorize_symbolic(symbs.buf); // GLOBAL!
 
-                    if (type_name && !LT_get(module,type_name,HEAD,KEEP)) {
-                        void *addr=NULL;
+                    if (type_name && !cif_bound(module,type_name)) {
                         char *linkage_symbol=(type_info->flags&TYPEF_LINKAGE)?attr_get(&type_info->ltv,TYPE_LINK):type_name;
-                        if (dlhandle) {
-                            dlerror(); // reset
-                            if ((addr=dlsym(dlhandle,linkage_symbol)))
-                                LT_put(module,type_name,TAIL,cif_create_cvar(&cvar_type->ltv,addr,NULL));
-                            else
-                                DEBUG(fprintf(stderr,"dlsym error: handle %x %s (%s)\n",dlhandle,dlerror(),type_name));
-                        } else
+                        if (dlhandle)
+                            cif_bind(module,bindings,dlhandle,type_name,linkage_symbol,&cvar_type->ltv);
+                        else
                             fprintf(stderr,"no dlhandle for function %s (%s)\n",linkage_symbol,type_name);
                     }
                 }
                 break;
             case DW_TAG_variable:
                 if (post) {
-                    if (type_name && !LT_get(module,type_name,HEAD,KEEP) && base_info) { // GLOBAL!
-                        void *addr=NULL;
-                        if (dlhandle) {
-                            dlerror(); // reset
-                            if ((addr=dlsym(dlhandle,type_name)))
-                                LT_put(module,type_name,TAIL,cif_create_cvar(&base_info->ltv,addr,NULL));
-                            else
-                                DEBUG(fprintf(stderr,"dlsym error: handle %x %s\n",dlhandle,dlerror()));
-                        } else
+                    if (type_name && !cif_bound(module,type_name) && base_info) { // GLOBAL!
+                        if (dlhandle)
+                            cif_bind(module,bindings,dlhandle,type_name,type_name,&base_info->ltv);
+                        else
                             fprintf(stderr,"no dlhandle for variable %s\n",type_name);
                     }
                 }
                 break;
             case DW_TAG_subrange_type:
                 if (type_name) // still want to dedup!
-                    categorize_symbolic(FORMATA(composite_name,strlen(type_name),"%s",type_name));
+                    categorize_symbolic(type_name);
                 break;
             case DW_TAG_member:
                 if (post && type_name && !attr_get(&type_info->ltv, TYPE_SYMB)) // if member not already named...
@@ -1294,25 +1960,25 @@ int cif_curate_module(LTV *module,int bootstrap)
                 break;
             case DW_TAG_formal_parameter: // name would be same as base, redundantly.
                 //if (post && base_symb)
-                //    categorize_symbolic(FORMATA(composite_name,strlen(base_symb),"%s",base_symb));
+                //    categorize_symbolic(base_symb);
                 break;
 
 
             case DW_TAG_reference_type: // C++?
                 if (post && base_symb)
-                    categorize_symbolic(FORMATA(composite_name,strlen(base_symb),"&(%s)",base_symb));
+                    categorize_symbolic(symb_printf(&symbs,0,"&(%s)",base_symb));
                 break;
             case DW_TAG_rvalue_reference_type:
                 if (post && base_symb)
-                    categorize_symbolic(FORMATA(composite_name,strlen(base_symb),"rval &(%s)",base_symb));
+                    categorize_symbolic(symb_printf(&symbs,0,"rval &(%s)",base_symb));
                 break;
             case DW_TAG_template_type_parameter:
                 if (post && base_symb)
-                    categorize_symbolic(FORMATA(composite_name,strlen(base_symb),"template_type_param %s",base_symb));
+                    categorize_symbolic(symb_printf(&symbs,0,"template_type_param %s",base_symb));
                 break;
             case DW_TAG_template_value_parameter:
                 if (post && base_symb)
-                    categorize_symbolic(FORMATA(composite_name,strlen(base_symb),"template_value_param %s",base_symb));
+                    categorize_symbolic(symb_printf(&symbs,0,"template_value_param %s",base_symb));
                 break;
 
             case DW_TAG_unspecified_parameters: // varargs
@@ -1327,6 +1993,10 @@ int cif_curate_module(LTV *module,int bootstrap)
     };
 
     int curate_die(Dwarf_Debug dbg,Dwarf_Die die,DIEWALK_FLAGS flags) {
+        Dwarf_Off offset;
+        Dwarf_Error error=0;
+        if (only_cu && (flags&RDW_is_info) && dwarf_dieoffset(die,&offset,&error)==DW_DLV_OK && offset!=only_cu)
+            return 0;
         int work_op(LTV *parent,Dwarf_Die die,int depth) { // propagates parentage through the stateless DIE_OP calls
             int status=0;
             Dwarf_Error error=0;
@@ -1335,6 +2005,10 @@ int cif_curate_module(LTV *module,int bootstrap)
 
             void read_cu_macros(void) { // inspired by https://github.com/tomhughes/libdwarf/blob/master/libdwarf/checkexamples.c
                 int status=0;
+                LT_BULK *defines=NULL; // collected per CU, merged into module in one pass
+                int ndefines=0,maxdefines=0;
+                CLL imports; // imported macro units still to read
+                CLL_init(&imports);
 
                 void macro_define(char *macro) {
                     int len=strlen(macro);
@@ -1347,8 +2021,11 @@ int cif_curate_module(LTV *module,int bootstrap)
                         if (len) {
                             //fprintf(stdout,name[namelen-1]!=')'?CODE_BLUE:CODE_GREEN);
                             //fprintf(stdout,"%s" CODE_RED " %s" CODE_RESET " (%d) \n",name,macro,len);
-                            if (name[namelen-1]!=')' && !LT_get(module,name,TAIL,KEEP))
-                                LT_put(module,name,TAIL,LTV_init(NEW(LTV),macro,len,LT_DUP));
+                            if (name[namelen-1]!=')') {
+                                if (ndefines==maxdefines)
+                                    defines=RENEW(defines,sizeof(LT_BULK)*(maxdefines=maxdefines?maxdefines*2:256));
+                                defines[ndefines++]=(LT_BULK) {bufdup(name,namelen),namelen,LTV_init(NEW(LTV),macro,len,LT_DUP)};
+                            }
                         }
                     }
                 };
@@ -1370,7 +2047,7 @@ int cif_curate_module(LTV *module,int bootstrap)
                         TRY(dwarf_get_macro_context(die,&version,&macro_context,&macro_unit_offset,&number_of_ops,&ops_total_byte_len,&err),"get primary macro context");
                         is_primary = FALSE;
                     } else {
-                        LTV *macro_ltv=LT_get(module,"macro context",HEAD,POP);
+                        LTV *macro_ltv=LTV_deq(&imports,HEAD);
                         if (!macro_ltv)
                             break;
                         macro_unit_offset=(Dwarf_Unsigned) macro_ltv->data;
@@ -1411,7 +2088,7 @@ int cif_curate_module(LTV *module,int bootstrap)
                                 break;
                             case DW_MACRO_import:
                                 STRY(DW_DLV_OK!=dwarf_get_macro_import(macro_context,k,&offset,&err),"call dwarf_get_macro_import");
-                                LT_put(module,"macro context",TAIL,LTV_init(NEW(LTV),(void *) offset,0,LT_IMM));
+                                LTV_enq(&imports,LTV_init(NEW(LTV),(void *) offset,0,LT_IMM),TAIL);
                                 break;
                             case DW_MACRO_import_sup:
                                 STRY(DW_DLV_OK!=dwarf_get_macro_import(macro_context,k,&offset,&err),"call dwarf_get_macro_import");
@@ -1425,9 +2102,14 @@ int cif_curate_module(LTV *module,int bootstrap)
                     if (macro_context)
                         dwarf_dealloc_macro_context(macro_context);
                     if (status)
-                        return;
+                        break;
                     macro_context = 0;
                 }
+
+                for (LTV *macro_ltv;(macro_ltv=LTV_deq(&imports,HEAD));)
+                    LTV_release(macro_ltv);
+                cu_unit->defines=defines; // see merge_unit
+                cu_unit->ndefines=ndefines;
             };
 
             int child_op(Dwarf_Debug dbg,Dwarf_Die die,DIEWALK_FLAGS flags) { return work_op(&type_info->ltv,die,depth+1); };
@@ -1439,7 +2121,7 @@ int cif_curate_module(LTV *module,int bootstrap)
                         break;
                     case DW_TAG_compile_unit:
                         if (!LTV_empty(&type_info->ltv) && name)
-                            STRY(!LT_put(module,name,TAIL,&type_info->ltv),"link cu to module");
+                            STRY(!LT_put(cu_unit->links,name,TAIL,&type_info->ltv),"link cu to module");
                         break;
                     case DW_TAG_subroutine_type:
                     case DW_TAG_subprogram:
@@ -1461,7 +2143,7 @@ int cif_curate_module(LTV *module,int bootstrap)
                         break;
                     case DW_TAG_unspecified_parameters: // varargs
                         if (parent)
-                            STRY(!LT_put(parent,"unspecified parameters",TAIL,&type_info->ltv),"link unspecified parameters to parent");
+                            STRY(!LT_put(parent,TYPE_VARARGS,TAIL,&type_info->ltv),"link unspecified parameters to parent");
                         break;
                     default:
                         if (parent && name)
@@ -1477,16 +2159,18 @@ int cif_curate_module(LTV *module,int bootstrap)
             char offset_str[TYPE_IDLEN];
             STRY(dwarf_dieoffset(die,&offset,&error),"get global die offset");
             DWARF_ID(offset_str,offset);
-            int is_cu=cu_data.header_cu_type==DW_IDX_compile_unit;
+            CU_DATA *cu_data=&cu_unit->cu_data;
+            int is_cu=cu_data->header_cu_type==DW_IDX_compile_unit;
 
-            if (!(type_info=(TYPE_INFO_LTV *) LT_get(index[is_cu],offset_str,HEAD,KEEP))) { // may have been curated previously
+            if (!(type_info=(TYPE_INFO_LTV *) LT_get(cu_unit->index[is_cu],offset_str,HEAD,KEEP)) && // may have been curated previously
+                !(type_info=(TYPE_INFO_LTV *) LT_get(index[is_cu],offset_str,HEAD,KEEP))) { // (merged units are only read while workers run)
                 // special derived LTV! LTV won't delete "itself" (i.e. data); LTV_release will delete the whole TYPE_INFO
                 STRY(!(type_info=NEW(TYPE_INFO_LTV)),"create a type_info item");
                 STRY(!LTV_init(&type_info->ltv,type_info,sizeof(TYPE_INFO_LTV),LT_BIN|LT_CVAR|LT_TYPE),"initialize type_info");
-                STRY(!LTV_put(LTV_list(type_ltvs),&type_info->ltv,HEAD,NULL),"put type_ltv on gc list"); // any unused types will be garbage collected later
+                STRY(!LTV_put(LTV_list(cu_unit->type_ltvs),&type_info->ltv,HEAD,NULL),"put type_ltv on gc list"); // any unused types will be garbage collected later
 
                 type_info->depth=depth;
-                STRY(populate_type_info(dbg,die,type_info,&cu_data),"populate die type info");
+                STRY(populate_type_info(dbg,die,type_info,cu_data),"populate die type info");
 
                 switch (type_info->tag) {
                     case DW_TAG_subprogram:
@@ -1508,21 +2192,21 @@ int cif_curate_module(LTV *module,int bootstrap)
 
                 if (type_info->tag!=DW_TAG_compile_unit || LT_get(module,name,HEAD,KEEP)) { // only traverse listed CU's siblings
                     STRY(link2parent(name),"link die to parent");
-                    STRY(!LT_put(index[is_cu],type_info->id_str,TAIL,&type_info->ltv),"index type info");
+                    STRY(!LT_put(cu_unit->index[is_cu],type_info->id_str,TAIL,&type_info->ltv),"index type info");
 
                     if (parent_type_info && (parent_type_info->tag==DW_TAG_type_unit)) {
-                        if (type_info->offset==cu_data.offset) {
-                            static char alias[32];
-                            DWARF_ALIAS(alias,cu_data.sig8);
-                            STRY(!LT_put(aliases,alias,TAIL,&type_info->ltv),"alias type info %s with %s",type_info->id_str,alias);
+                        if (type_info->offset==cu_data->offset) {
+                            char alias[32];
+                            DWARF_ALIAS(alias,cu_data->sig8);
+                            STRY(!LT_put(cu_unit->aliases,alias,TAIL,&type_info->ltv),"alias type info %s with %s",type_info->id_str,alias);
                             DEBUG(fprintf(stdout,"--- aliasing %s with %s\n",type_info->id_str,alias));
                         }
                     }
 
                     if ((type_info->flags&TYPEF_IS_DECL) && (type_info->flags&TYPEF_SIGNATURE)) {
-                        static char alias[32];
+                        char alias[32];
                         DWARF_ALIAS(alias,type_info->sig8);
-                        STRY(!LT_put(aliases,alias,TAIL,&type_info->ltv),"alias type info %s with %s",type_info->id_str,alias);
+                        STRY(!LT_put(cu_unit->aliases,alias,TAIL,&type_info->ltv),"alias type info %s with %s",type_info->id_str,alias);
                         DEBUG(fprintf(stdout,"--- alias %s sig %s\n",type_info->id_str,alias));
                     }
 
@@ -1551,7 +2235,7 @@ int cif_curate_module(LTV *module,int bootstrap)
                     tried=1;
                 } else if ((type_info->flags&TYPEF_BASE) || // base is signature
                            ((type_info->flags&TYPEF_SIGNATURE) && !(type_info->flags&TYPEF_IS_DECL))) {
-                    static char alias[32];
+                    char alias[32];
                     DWARF_ALIAS(alias,type_info->sig8);
                     base=LT_get(aliases,alias,HEAD,KEEP);
                     tried=1;
@@ -1612,24 +2296,457 @@ int cif_curate_module(LTV *module,int bootstrap)
 
     char *filename=FORMATA(filename,module->len,"%s",module->data);
 
-    STRY(traverse_cus(filename,curate_die,&cu_data,RDW_traverse_sibs|RDW_is_info),"traverse type info units");
-    STRY(traverse_cus(filename,curate_die,&cu_data,RDW_traverse_sibs),"traverse compile units");
+    void merge_unit(CU_UNIT *unit) { // in unit order, so every name collects its values as a serial walk would have
+        LTV_merge(LTV_list(type_ltvs),LTV_list(unit->type_ltvs),HEAD);
+        merge_dict(index[0],unit->index[0]);
+        merge_dict(index[1],unit->index[1]);
+        merge_dict(aliases,unit->aliases);
+        merge_dict(module,unit->links);
+        if (unit->ndefines) // first definition wins, as does anything already in module
+            LTV_bulk(module,unit->defines,unit->ndefines,LT_BULK_FIRST);
+        for (int i=0;i<unit->ndefines;i++)
+            DELETE(unit->defines[i].name);
+        unit->ndefines=0;
+    };
+
+    int curate_units(DIEWALK_FLAGS flags) {
+        int status=0,nunits=0,maxunits=0,curating=cif_curating;
+        CU_UNIT **units=NULL;
+        pthread_mutex_t units_mutex=PTHREAD_MUTEX_INITIALIZER;
+
+        CU_DATA *claim_unit(int cu) { // runs on the claiming worker
+            CU_UNIT *unit=cu_unit_new();
+            pthread_mutex_lock(&units_mutex);
+            if (cu>=maxunits) {
+                units=RENEW(units,sizeof(CU_UNIT *)*MAX(cu+1,maxunits*2));
+                memset(units+maxunits,0,sizeof(CU_UNIT *)*(MAX(cu+1,maxunits*2)-maxunits));
+                maxunits=MAX(cu+1,maxunits*2);
+            }
+            units[cu]=unit;
+            nunits=MAX(nunits,cu+1);
+            pthread_mutex_unlock(&units_mutex);
+            cif_curating=1; // a worker takes the module's lazy placeholders as-is
+            return &(cu_unit=unit)->cu_data;
+        };
+
+        if (only_cu && (flags&RDW_is_info)) { // straight to the unit, rather than past every header before it
+            LTV *debug_link_filename=debug_filename(filename);
+            status=traverse_unit_at(debug_link_filename?(char *) debug_link_filename->data:filename,curate_die,claim_unit,only_cu);
+            LTV_release(debug_link_filename);
+        }
+        else
+            status=traverse_cus_parallel(filename,curate_die,claim_unit,only_cu?1:cif_curate_threads(),flags);
+        cif_curating=curating;
+        cu_unit=NULL;
+        for (int i=0;i<nunits;i++) {
+            if (!status && units[i])
+                merge_unit(units[i]);
+            cu_unit_free(units[i]);
+        }
+        DELETE(units);
+        return status;
+    };
+
+    // BTF stands in for the DWARF walk: each BTF type becomes the type_info its die would have,
+    // named by its type id (children numbered after the last type), all under one compile unit.
+    int curate_btf(LTV *btf) {
+        int status=0;
+        struct btf_header *hdr=(struct btf_header *) btf->data;
+        char *strs=NULL,*types_start=NULL,*types_end=NULL;
+        struct btf_type **types=NULL;
+        int ntypes=0,maxtypes=0,next_id=0,linkage=0; // some producers (gcc 12) mark every function static
+        TYPE_INFO_LTV *cu=NULL;
+        LTV *defs=LTV_NULL_HASH; // "struct x"/"union x" definitions, for resolving FWDs
+
+        char *btf_name(unsigned offset) { return offset && offset<hdr->str_len && strs[offset]?strs+offset:NULL; };
+
+        int btf_extra(struct btf_type *t) { // bytes following t
+            int vlen=BTF_INFO_VLEN(t->info);
+            switch (BTF_INFO_KIND(t->info)) {
+                case BTF_KIND_INT:        return sizeof(unsigned);
+                case BTF_KIND_ARRAY:      return sizeof(struct btf_array);
+                case BTF_KIND_STRUCT:
+                case BTF_KIND_UNION:      return vlen*sizeof(struct btf_member);
+                case BTF_KIND_ENUM:       return vlen*sizeof(struct btf_enum);
+                case BTF_KIND_FUNC_PROTO: return vlen*sizeof(struct btf_param);
+                case BTF_KIND_VAR:        return sizeof(struct btf_var);
+                case BTF_KIND_DATASEC:    return vlen*sizeof(struct btf_var_secinfo);
+                case BTF_KIND_DECL_TAG:   return sizeof(struct btf_decl_tag);
+                case BTF_KIND_ENUM64:     return vlen*sizeof(struct btf_enum64);
+                case BTF_KIND_PTR: case BTF_KIND_FWD: case BTF_KIND_TYPEDEF: case BTF_KIND_VOLATILE: case BTF_KIND_CONST:
+                case BTF_KIND_RESTRICT: case BTF_KIND_FUNC: case BTF_KIND_FLOAT: case BTF_KIND_TYPE_TAG:
+                    return 0;
+                default:                  return -1;
+            }
+        };
+
+        unsigned btf_resolve(unsigned id) { // skip type tags, and forwards that have a definition
+            for (int hops=0;id && id<ntypes && hops<ntypes;hops++) {
+                struct btf_type *t=types[id];
+                char *name=NULL,*key=NULL;
+                LTV *def=NULL;
+                if (BTF_INFO_KIND(t->info)==BTF_KIND_TYPE_TAG)
+                    id=t->type;
+                else if (BTF_INFO_KIND(t->info)==BTF_KIND_FWD && (name=btf_name(t->name_off)) &&
+                         (def=LT_get(defs,FORMATA(key,strlen(name)+8,"%s %s",BTF_INFO_KFLAG(t->info)?"union":"struct",name),HEAD,KEEP)))
+                    return (unsigned) (long) def->data;
+                else
+                    break;
+            }
+            return id;
+        };
+
+        int btf_sizeof(unsigned id) { // bytes of a (possibly qualified) type
+            for (int hops=0;(id=btf_resolve(id)) && id<ntypes && hops<ntypes;hops++) {
+                struct btf_type *t=types[id];
+                switch (BTF_INFO_KIND(t->info)) {
+                    case BTF_KIND_TYPEDEF: case BTF_KIND_VOLATILE: case BTF_KIND_CONST: case BTF_KIND_RESTRICT:
+                        id=t->type;
+                        continue;
+                    case BTF_KIND_PTR:
+                        return sizeof(void *);
+                    case BTF_KIND_INT: case BTF_KIND_ENUM: case BTF_KIND_ENUM64: case BTF_KIND_FLOAT:
+                    case BTF_KIND_STRUCT: case BTF_KIND_UNION:
+                        return t->size;
+                    default:
+                        return 0;
+                }
+            }
+            return 0;
+        };
+
+        TYPE_INFO_LTV *new_type_info(LTV *parent,int id,Dwarf_Half tag,char *name,unsigned base,int depth) {
+            TYPE_INFO_LTV *type_info=NULL;
+            if (!(type_info=NEW(TYPE_INFO_LTV)) || !LTV_init(&type_info->ltv,type_info,sizeof(TYPE_INFO_LTV),LT_BIN|LT_CVAR|LT_TYPE))
+                return NULL;
+            LTV_put(LTV_list(type_ltvs),&type_info->ltv,HEAD,NULL);
+            type_info->tag=tag;
+            type_info->depth=depth;
+            type_info->flags=TYPEF_IS_INFO;
+            DWARF_ID(type_info->id_str,type_info->offset=id);
+            if ((base=btf_resolve(base))) {
+                type_info->flags|=TYPEF_BASE;
+                DWARF_ID(type_info->base_str,type_info->base=base);
+            }
+            if (name) {
+                type_info->flags|=TYPEF_HAS_NAME;
+                attr_set(&type_info->ltv,TYPE_NAME,name);
+            }
+            LT_put(index[1],type_info->id_str,TAIL,&type_info->ltv);
+            if (parent) // see link2parent
+                switch (tag) {
+                    case DW_TAG_subrange_type:
+                        LT_put(parent,"subrange type",TAIL,&type_info->ltv);
+                        break;
+                    case DW_TAG_member:
+                    case DW_TAG_formal_parameter:
+                        LT_put(parent,TYPE_LIST,TAIL,&type_info->ltv);
+                        if (name)
+                            LT_put(parent,name,TAIL,&type_info->ltv);
+                        break;
+                    case DW_TAG_unspecified_parameters:
+                        LT_put(parent,TYPE_VARARGS,TAIL,&type_info->ltv);
+                        break;
+                    default:
+                        if (name)
+                            LT_put(parent,name,TAIL,&type_info->ltv);
+                        break;
+                }
+            return type_info;
+        };
+
+        int add_params(TYPE_INFO_LTV *function,struct btf_type *proto) {
+            int status=0;
+            struct btf_param *param=(struct btf_param *) (proto+1);
+            for (int i=0,vlen=BTF_INFO_VLEN(proto->info);i<vlen;i++,param++)
+                if (i==vlen-1 && !param->type && !param->name_off) // varargs
+                    STRY(!new_type_info(&function->ltv,next_id++,DW_TAG_unspecified_parameters,NULL,0,function->depth+1),"add varargs");
+                else
+                    STRY(!new_type_info(&function->ltv,next_id++,DW_TAG_formal_parameter,btf_name(param->name_off),param->type,function->depth+1),"add parameter");
+        done:
+            return status;
+        };
+
+        int add_type(unsigned id) {
+            int status=0;
+            struct btf_type *t=types[id];
+            char *name=btf_name(t->name_off);
+            int kind=BTF_INFO_KIND(t->info),kflag=BTF_INFO_KFLAG(t->info),vlen=BTF_INFO_VLEN(t->info);
+            TYPE_INFO_LTV *type_info=NULL,*child=NULL;
+
+            switch (kind) {
+                case BTF_KIND_INT: {
+                    unsigned encoding=BTF_INT_ENCODING(*(unsigned *) (t+1));
+                    STRY(!(type_info=new_type_info(&cu->ltv,id,DW_TAG_base_type,name,0,1)),"add int");
+                    type_info->encoding=(encoding&BTF_INT_BOOL)? DW_ATE_boolean:
+                        (encoding&BTF_INT_CHAR)? ((encoding&BTF_INT_SIGNED)?DW_ATE_signed_char:DW_ATE_unsigned_char):
+                        (encoding&BTF_INT_SIGNED)? DW_ATE_signed:DW_ATE_unsigned;
+                    type_info->bytesize=t->size;
+                    type_info->flags|=TYPEF_ENCODING|TYPEF_BYTESIZE;
+                    break;
+                }
+                case BTF_KIND_FLOAT:
+                    STRY(!(type_info=new_type_info(&cu->ltv,id,DW_TAG_base_type,name,0,1)),"add float");
+                    type_info->encoding=DW_ATE_float;
+                    type_info->bytesize=t->size;
+                    type_info->flags|=TYPEF_ENCODING|TYPEF_BYTESIZE;
+                    break;
+                case BTF_KIND_PTR:
+                    STRY(!(type_info=new_type_info(&cu->ltv,id,DW_TAG_pointer_type,NULL,t->type,1)),"add pointer");
+                    type_info->bytesize=sizeof(void *);
+                    type_info->flags|=TYPEF_BYTESIZE;
+                    break;
+                case BTF_KIND_ARRAY: {
+                    struct btf_array *array=(struct btf_array *) (t+1);
+                    STRY(!(type_info=new_type_info(&cu->ltv,id,DW_TAG_array_type,NULL,array->type,1)),"add array");
+                    STRY(!(child=new_type_info(&type_info->ltv,next_id++,DW_TAG_subrange_type,NULL,array->index_type,2)),"add array subrange");
+                    if (array->nelems) {
+                        child->upper_bound=array->nelems-1;
+                        child->flags|=TYPEF_UPPERBOUND;
+                    }
+                    break;
+                }
+                case BTF_KIND_STRUCT:
+                case BTF_KIND_UNION: {
+                    struct btf_member *member=(struct btf_member *) (t+1);
+                    STRY(!(type_info=new_type_info(&cu->ltv,id,kind==BTF_KIND_UNION?DW_TAG_union_type:DW_TAG_structure_type,name,0,1)),"add struct/union");
+                    type_info->bytesize=t->size;
+                    type_info->flags|=TYPEF_BYTESIZE;
+                    for (int i=0;i<vlen;i++,member++) {
+                        unsigned bits=kflag?BTF_MEMBER_BITFIELD_SIZE(member->offset):0;
+                        unsigned offset=kflag?BTF_MEMBER_BIT_OFFSET(member->offset):member->offset;
+                        STRY(!(child=new_type_info(&type_info->ltv,next_id++,DW_TAG_member,btf_name(member->name_off),member->type,2)),"add member");
+                        child->flags|=TYPEF_MEMBERLOC;
+                        child->data_member_location=offset/8;
+                        if (bits) { // as DWARF 2-4 would have it: the containing unit's offset, and bit offset from its msb
+                            unsigned unit=MAX(btf_sizeof(member->type),1)*8,storage=offset-offset%unit;
+                            child->data_member_location=storage/8;
+                            child->bytesize=unit/8;
+                            child->bitsize=bits;
+                            child->bitoffset=unit-bits-(offset-storage);
+                            child->flags|=TYPEF_BYTESIZE|TYPEF_BITSIZE|TYPEF_BITOFFSET;
+                        }
+                    }
+                    break;
+                }
+                case BTF_KIND_ENUM:
+                case BTF_KIND_ENUM64: {
+                    STRY(!(type_info=new_type_info(&cu->ltv,id,DW_TAG_enumeration_type,name,0,1)),"add enum");
+                    type_info->bytesize=t->size;
+                    type_info->flags|=TYPEF_BYTESIZE;
+                    for (int i=0;i<vlen;i++) {
+                        struct btf_enum *e32=(struct btf_enum *) (t+1)+i;
+                        struct btf_enum64 *e64=(struct btf_enum64 *) (t+1)+i;
+                        unsigned name_off=kind==BTF_KIND_ENUM?e32->name_off:e64->name_off;
+                        STRY(!(child=new_type_info(&type_info->ltv,next_id++,DW_TAG_enumerator,btf_name(name_off),0,2)),"add enumerator");
+                        child->const_value=kind==BTF_KIND_ENUM? // read as signed, as dwarf_formsdata would
+                            (Dwarf_Signed) e32->val:
+                            (Dwarf_Signed) (((unsigned long long) e64->val_hi32<<32)|e64->val_lo32);
+                        child->flags|=TYPEF_CONSTVAL;
+                    }
+                    break;
+                }
+                case BTF_KIND_FWD:
+                    if (btf_resolve(id)==id) { // never defined
+                        STRY(!(type_info=new_type_info(&cu->ltv,id,kflag?DW_TAG_union_type:DW_TAG_structure_type,name,0,1)),"add declaration");
+                        type_info->flags|=TYPEF_IS_DECL;
+                    }
+                    break;
+                case BTF_KIND_TYPEDEF:
+                    STRY(!new_type_info(&cu->ltv,id,DW_TAG_typedef,name,t->type,1),"add typedef");
+                    break;
+                case BTF_KIND_VOLATILE:
+                    STRY(!new_type_info(&cu->ltv,id,DW_TAG_volatile_type,NULL,t->type,1),"add volatile");
+                    break;
+                case BTF_KIND_CONST:
+                    STRY(!new_type_info(&cu->ltv,id,DW_TAG_const_type,NULL,t->type,1),"add const");
+                    break;
+                case BTF_KIND_RESTRICT:
+                    STRY(!new_type_info(&cu->ltv,id,DW_TAG_restrict_type,NULL,t->type,1),"add restrict");
+                    break;
+                case BTF_KIND_FUNC: // skip statics (cf. populate_type_info's TYPEF_EXTERNAL), if linkage was recorded at all
+                    if (name && (vlen!=BTF_FUNC_STATIC || !linkage) && t->type<ntypes && BTF_INFO_KIND(types[t->type]->info)==BTF_KIND_FUNC_PROTO) {
+                        STRY(!(type_info=new_type_info(&cu->ltv,id,DW_TAG_subprogram,name,types[t->type]->type,1)),"add function");
+                        type_info->external=1;
+                        type_info->flags|=TYPEF_EXTERNAL;
+                        STRY(add_params(type_info,types[t->type]),"add function parameters");
+                    }
+                    break;
+                case BTF_KIND_VAR:
+                    if (name && ((struct btf_var *) (t+1))->linkage==BTF_VAR_GLOBAL_ALLOCATED) {
+                        STRY(!(type_info=new_type_info(&cu->ltv,id,DW_TAG_variable,name,t->type,1)),"add variable");
+                        type_info->external=1;
+                        type_info->flags|=TYPEF_EXTERNAL;
+                    }
+                    break;
+                default: // FUNC_PROTO (unnamed, so uncurated, like DWARF's unnamed subroutine types), DATASEC, and tags
+                    break;
+            }
+        done:
+            return status;
+        };
+
+        STRY(btf->len<sizeof(*hdr) || hdr->magic!=BTF_MAGIC || hdr->version!=BTF_VERSION ||
+             hdr->hdr_len<sizeof(*hdr) || hdr->hdr_len>btf->len ||
+             (unsigned long long) hdr->type_off+hdr->type_len>btf->len-hdr->hdr_len ||
+             (unsigned long long) hdr->str_off+hdr->str_len>btf->len-hdr->hdr_len || !hdr->str_len,
+             "validate btf header");
+        strs=(char *) hdr+hdr->hdr_len+hdr->str_off;
+        STRY(strs[hdr->str_len-1],"validate btf strings");
+        types_start=(char *) hdr+hdr->hdr_len+hdr->type_off;
+        types_end=types_start+hdr->type_len;
+
+        for (char *t=types_start;t<types_end;) { // type ids count from 1; 0 is void
+            int extra;
+            STRY(t+sizeof(struct btf_type)>types_end || (extra=btf_extra((struct btf_type *) t))<0 ||
+                 t+sizeof(struct btf_type)+extra>types_end,"validate btf type %d",ntypes+1);
+            if (ntypes+2>maxtypes)
+                types=RENEW(types,sizeof(struct btf_type *)*(maxtypes=maxtypes?maxtypes*2:1024));
+            types[++ntypes]=(struct btf_type *) t;
+            t+=sizeof(struct btf_type)+extra;
+        }
+        ntypes++; // one past the last id
+
+        void index_def(int id,int kind,char *name) { // alloca freed on return
+            char *def=NULL;
+            if (!LT_get(defs,FORMATA(def,strlen(name)+8,"%s %s",kind==BTF_KIND_UNION?"union":"struct",name),HEAD,KEEP))
+                LT_put(defs,def,TAIL,LTV_init(NEW(LTV),(void *) (long) id,0,LT_IMM));
+        }
+
+        for (int id=1;id<ntypes;id++) {
+            int kind=BTF_INFO_KIND(types[id]->info);
+            if (kind==BTF_KIND_FUNC && BTF_INFO_VLEN(types[id]->info)!=BTF_FUNC_STATIC)
+                linkage=1;
+            char *name=btf_name(types[id]->name_off);
+            if (name && (kind==BTF_KIND_STRUCT || kind==BTF_KIND_UNION))
+                index_def(id,kind,name);
+        }
+
+        next_id=ntypes;
+        STRY(!(cu=new_type_info(NULL,next_id++,DW_TAG_compile_unit,filename,0,0)),"add btf compile unit");
+        STRY(!LT_put(module,filename,TAIL,&cu->ltv),"link cu to module");
+        for (int id=1;id<ntypes;id++)
+            STRY(add_type(id),"add btf type %d",id);
+    done:
+        DELETE(types);
+        LTV_release(defs);
+        return status;
+    };
+
+    LTV *btf=only_cu?NULL:cif_btf(filename);
+    if (btf) {
+        TRYCATCH(curate_btf(btf),status,release_btf,"curate btf types");
+    release_btf:
+        LTV_release(btf);
+        if (status)
+            goto done;
+    } else {
+        STRY(curate_units(RDW_traverse_sibs|RDW_is_info),"traverse type info units");
+        STRY(curate_units(RDW_traverse_sibs),"traverse compile units");
+    }
 
     STRY(ltv_traverse(index[1],resolve_bases,NULL)!=NULL,"resolve type info bases");
     STRY(ltv_traverse(index[0],resolve_bases,NULL)!=NULL,"resolve compile unit bases");
 
     resolve_symbols(filename);
 
+    void tidy_unit(LTV *index) { // remove_die_names/resolve_meta for just the types this pass indexed
+        LT_TRAVERSE_FLAGS flags=LT_TRAVERSE_LTV;
+        for (LTI *lti=LTI_first(index);lti;lti=LTI_iter(index,lti,FWD))
+            for (LTVR *ltvr=(LTVR *) CLL_next(&lti->ltvs,NULL,FWD);ltvr;ltvr=(LTVR *) CLL_next(&lti->ltvs,&ltvr->lnk,FWD))
+                if (ltvr->ltv->flags&LT_TYPE) {
+                    attr_del(ltvr->ltv,TYPE_NAME);
+                    resolve_meta(&lti,ltvr,&ltvr->ltv,1,&flags);
+                }
+    }
+
+    if (only_cu) { // the rest of the module was tidied when it was curated
+        tidy_unit(index[0]);
+        tidy_unit(index[1]);
+    }
+
     LTV_release(type_ltvs);
     LTV_release(index[0]);
     LTV_release(index[1]);
     LTV_release(aliases);
 
-    STRY(ltv_traverse(module,remove_die_names,resolve_meta)!=NULL,"clean up and bind pointers to pointees"); // link X.meta to pointer-to-X
+    if (!only_cu) {
+        STRY(ltv_traverse(module,remove_die_names,resolve_meta)!=NULL,"clean up and bind pointers to pointees"); // link X.meta to pointer-to-X
+        printf("Finished curating module\n");
+        cif_cache_save(module,cache); // best effort
+    }
+
+ done:
+    symb_free(&symbs);
+    LTV_release(cache);
+    return status;
+}
 
-    printf("Finished curating module\n");
+// importbench: curate module's file twice, bypassing the cache, once with the usual workers and once
+// serially, time both, and check that they hold the same names with the same values in the same order
+extern int cif_import_verify(LTV *module)
+{
+    int status=0,mismatches=0,threads=cif_curate_threads();
+    LTV *parallel=LTV_init(NEW(LTV),module->data,module->len,LT_DUP);
+    LTV *serial=LTV_init(NEW(LTV),module->data,module->len,LT_DUP);
+    struct timespec t[3];
+
+    double elapsed(int i) { return (t[i+1].tv_sec-t[i].tv_sec)+(t[i+1].tv_nsec-t[i].tv_nsec)/1e9; }
+
+    char *symb(LTV *ltv) { // what a value stands for, independent of where either pass allocated it
+        if (ltv->flags&LT_TYPE)
+            return ((TYPE_INFO_LTV *) ltv)->id_str;
+        if (ltv->flags&LT_CVAR) {
+            LTV *type=LT_get(ltv,TYPE_BASE,HEAD,KEEP);
+            return type?attr_get(type,TYPE_SYMB):NULL;
+        }
+        return NULL;
+    }
 
+    int same(LTV *a,LTV *b) {
+        char *sa=symb(a),*sb=symb(b);
+        if ((a->flags^b->flags)&(LT_TYPE|LT_CVAR|LT_NAP))
+            return false;
+        if (a->flags&(LT_TYPE|LT_CVAR))
+            return sa==sb || (sa && sb && !strcmp(sa,sb));
+        if (a->flags&LT_NAP)
+            return a->data==b->data;
+        return a->len==b->len && !memcmp(a->data,b->data,a->len);
+    }
+
+    void mismatch(LTI *lti,char *what) {
+        if (mismatches++<10)
+            fprintf(stderr,"import mismatch at \"%.*s\": %s\n",lti->len,lti->name,what);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC,&t[0]);
+    STRY(cif_curate_module(parallel,0,0),"curate %s in parallel",(char *) module->data);
+    clock_gettime(CLOCK_MONOTONIC,&t[1]);
+    cif_threads=1;
+    status=cif_curate_module(serial,0,0);
+    cif_threads=0;
+    STRY(status,"curate %s serially",(char *) module->data);
+    clock_gettime(CLOCK_MONOTONIC,&t[2]);
+
+    LTI *p=LTI_first(parallel),*q=LTI_first(serial);
+    for (;p && q;p=LTI_iter(parallel,p,FWD),q=LTI_iter(serial,q,FWD)) {
+        if (strnncmp(p->name,p->len,q->name,q->len))
+            break; // the walks are out of step from here on
+        int n=LTV_len(&p->ltvs);
+        if (n!=LTV_len(&q->ltvs))
+            mismatch(p,"different number of values");
+        for (int i=0;i<n && i<LTV_len(&q->ltvs);i++)
+            if (!same(LTV_at(&p->ltvs,i,HEAD),LTV_at(&q->ltvs,i,HEAD)))
+                mismatch(p,"different values");
+    }
+    if (p || q)
+        mismatch(p && (!q || strnncmp(p->name,p->len,q->name,q->len)<0)?p:q,"only in one pass");
+    fprintf(stderr,"curated %s: %d threads %.3fs, serial %.3fs, %s\n",(char *) module->data,threads,elapsed(0),elapsed(1),
+            mismatches?"MISMATCHED":"identical");
+    STRY(mismatches,"match parallel and serial imports (%d mismatches)",mismatches);
  done:
+    LTV_release(parallel);
+    LTV_release(serial);
     return status;
 }
 
@@ -1674,6 +2791,34 @@ TYPE_UVALUE *Type_pullUVAL(TYPE_UVALUE *uval,char *buf)
     return uval;
 }
 
+// convert a native immediate (LT_I64/LT_F64) into uval's dutype; no text involved
+TYPE_UVALUE *Type_immUVAL(TYPE_UVALUE *uval,LTV *imm)
+{
+    long long i=(imm->flags&LT_F64)?(long long) LTV_DBL(imm):LTV_INT(imm);
+    double d=(imm->flags&LT_F64)?LTV_DBL(imm):(double) LTV_INT(imm);
+    return Type_numUVAL(uval,i,d);
+}
+
+// store a number, given as both integer and real, in uval's dutype
+TYPE_UVALUE *Type_numUVAL(TYPE_UVALUE *uval,long long i,double d)
+{
+    switch(uval->base.dutype) {
+        case TYPE_INT1S:   uval->int1s.val=i;   break;
+        case TYPE_INT2S:   uval->int2s.val=i;   break;
+        case TYPE_INT4S:   uval->int4s.val=i;   break;
+        case TYPE_INT8S:   uval->int8s.val=i;   break;
+        case TYPE_INT1U:   uval->int1u.val=i;   break;
+        case TYPE_INT2U:   uval->int2u.val=i;   break;
+        case TYPE_INT4U:   uval->int4u.val=i;   break;
+        case TYPE_INT8U:   uval->int8u.val=i;   break;
+        case TYPE_FLOAT4:  uval->float4.val=d;  break;
+        case TYPE_FLOAT8:  uval->float8.val=d;  break;
+        case TYPE_FLOAT16: uval->float16.val=d; break;
+        case TYPE_ADDR:    uval->addr.val=(void *) i; break;
+        default: break;
+    }
+    return uval;
+}
 
 #define UVAL2VAR(uval,var)                                                      \
     do {                                                                        \
@@ -1716,6 +2861,9 @@ TYPE_UTYPE Type_getUVAL(LTV *cvar,TYPE_UVALUE *uval)
     int status=0;
     LTV *type=NULL;
     STRY(!cvar || !uval,"validate params");
+    BZERO(*uval);
+    if (cvar->flags&LT_I64) { uval->int8s.dutype=TYPE_INT8S;   uval->int8s.val=LTV_INT(cvar);  goto done; }
+    if (cvar->flags&LT_F64) { uval->float8.dutype=TYPE_FLOAT8; uval->float8.val=LTV_DBL(cvar); goto done; }
     TRYCATCH(!(type=cif_find_concrete(LT_get(cvar,TYPE_BASE,HEAD,KEEP))),0,done,"retrieve cvar basic type");
     TYPE_INFO_LTV *type_info=(TYPE_INFO_LTV *) type->data;
 
@@ -2250,13 +3398,22 @@ LTV *cif_coerce_i2c(LTV *ltv,LTV *type)
     if (!(ltv->flags&LT_CVAR)) { // first, dress a non-cvar ltv up in something appropriate
         if (match("(LTV)*"))
             result=cif_create_cvar(cif_type_info("LTV"),ltv,NULL); // encaps LTV when dest is an LTV*
-        else if (match("(char)*") || match("(unsigned char)*")) // ltv data -> char array
+        else if (match("(char)*") || match("(unsigned char)*")) { // ltv data -> char array
+            if (ltv->flags&LT_NUM) { // a native number has no text; render some for the string to point at
+                char *buf=NULL;
+                if (ltv->flags&LT_I64) FORMATA(buf,32,"%lld",LTV_INT(ltv));
+                else                   FORMATA(buf,32,"%.17g",LTV_DBL(ltv));
+                ltv=LTV_init(NEW(LTV),buf,-1,LT_DUP); // the TYPE_CAST link below keeps it alive
+            }
             STRY(!(result=cif_create_cvar(type_base,&ltv->data,NULL)),"create string coersion"); // cvar->data=&ltv->data, i.e. cvar will point to a void*
-        else if (is_readable(type_base)) {
+        } else if (is_readable(type_base)) {
             TYPE_UVALUE dst_uval={},src_uval={};
             result=cif_create_cvar(type,NULL,NULL);
-            Type_getUVAL(result,&dst_uval); // try to read plaintext into a base type
-            Type_putUVAL(result,Type_pullUVAL(&dst_uval,ltv->data));
+            Type_getUVAL(result,&dst_uval); // learn the base type...
+            if (ltv->flags&LT_NUM) // ...and convert a native number directly...
+                Type_putUVAL(result,Type_immUVAL(&dst_uval,ltv));
+            else // ...or read plaintext into it
+                Type_putUVAL(result,Type_pullUVAL(&dst_uval,ltv->data));
         } else {
             STRY((vm_throw(LTV_NULL),1),"no i2c coersion");
         }
@@ -2285,7 +3442,7 @@ LTV *cif_coerce_i2c(LTV *ltv,LTV *type)
 }
 
 // coerce C return value into interpreter-friendly LTV
-// (mostly unwrapping LTV cvars)
+// (mostly unwrapping LTV cvars, and turning scalars into native numbers)
 LTV *cif_coerce_c2i(LTV *ltv)
 {
     int status=0;
@@ -2306,6 +3463,23 @@ LTV *cif_coerce_c2i(LTV *ltv)
     if (type_name && !strcmp(type_name,"(LTV)*")) {
         result=*(LTV **) ltv->data;
         LTV_release(ltv);
+    } else if ((type=cif_find_concrete(type)) && ((TYPE_INFO_LTV *) type)->tag==DW_TAG_base_type) {
+        TYPE_UVALUE uval={};
+        switch (Type_getUVAL(ltv,&uval)) {
+            case TYPE_INT1S:   result=LTV_I64(uval.int1s.val);   break;
+            case TYPE_INT2S:   result=LTV_I64(uval.int2s.val);   break;
+            case TYPE_INT4S:   result=LTV_I64(uval.int4s.val);   break;
+            case TYPE_INT8S:   result=LTV_I64(uval.int8s.val);   break;
+            case TYPE_INT1U:   result=LTV_I64(uval.int1u.val);   break;
+            case TYPE_INT2U:   result=LTV_I64(uval.int2u.val);   break;
+            case TYPE_INT4U:   result=LTV_I64(uval.int4u.val);   break;
+            case TYPE_INT8U:   result=LTV_I64(uval.int8u.val);   break; // same bits; coerces back intact
+            case TYPE_FLOAT4:  result=LTV_F64(uval.float4.val);  break;
+            case TYPE_FLOAT8:  result=LTV_F64(uval.float8.val);  break;
+            default: break; // long double etc. stay cvars
+        }
+        if (result!=ltv)
+            LTV_release(ltv);
     }
 
  done:
@@ -2316,9 +3490,8 @@ int cif_ffi_call(LTV *cif,void *loc,LTV *rval,CLL *coerced_args)
 {
     int status=0;
     int index=0;
-    void **args=NULL;
     int arity=CLL_len(coerced_args);
-    args=calloc(sizeof(void *),arity);
+    void *args[arity+1]; // gone with the call
 
     void *index_arg(CLL *lnk) {
         LTV *ltv=((LTVR *) lnk)->ltv;
@@ -2336,6 +3509,481 @@ int cif_ffi_call(LTV *cif,void *loc,LTV *rval,CLL *coerced_args)
     return status;
 }
 
+// the TYPE_UVALUE kind a scalar type reads and writes as (see Type_getUVAL)
+static TYPE_UTYPE Type_utype(LTV *type)
+{
+    TYPE_INFO_LTV *type_info=(TYPE_INFO_LTV *) type;
+    ull size=type_info->bytesize;
+    ull encoding;
+    switch (type_info->tag) {
+        case DW_TAG_enumeration_type: encoding=DW_ATE_signed;       break;
+        case DW_TAG_pointer_type:     encoding=DW_ATE_unsigned;     break;
+        case DW_TAG_base_type:        encoding=type_info->encoding; break;
+        default: return TYPE_NONE;
+    }
+    switch (encoding) {
+        case DW_ATE_float:
+            return size==4?TYPE_FLOAT4:size==8?TYPE_FLOAT8:size==16?TYPE_FLOAT16:TYPE_NONE;
+        case DW_ATE_signed:
+        case DW_ATE_signed_char:
+            return size==1?TYPE_INT1S:size==2?TYPE_INT2S:size==4?TYPE_INT4S:size==8?TYPE_INT8S:TYPE_NONE;
+        case DW_ATE_boolean:
+        case DW_ATE_unsigned:
+        case DW_ATE_unsigned_char:
+            return size==1?TYPE_INT1U:size==2?TYPE_INT2U:size==4?TYPE_INT4U:size==8?TYPE_INT8U:TYPE_NONE;
+        default:
+            return TYPE_NONE;
+    }
+}
+
+static void *Type_UVALdata(TYPE_UVALUE *uval)
+{
+    switch(uval->base.dutype) {
+        case TYPE_INT1S:   return &uval->int1s.val;
+        case TYPE_INT2S:   return &uval->int2s.val;
+        case TYPE_INT4S:   return &uval->int4s.val;
+        case TYPE_INT8S:   return &uval->int8s.val;
+        case TYPE_INT1U:   return &uval->int1u.val;
+        case TYPE_INT2U:   return &uval->int2u.val;
+        case TYPE_INT4U:   return &uval->int4u.val;
+        case TYPE_INT8U:   return &uval->int8u.val;
+        case TYPE_FLOAT4:  return &uval->float4.val;
+        case TYPE_FLOAT8:  return &uval->float8.val;
+        case TYPE_FLOAT16: return &uval->float16.val;
+        case TYPE_ADDR:    return &uval->addr.val;
+        default:           return NULL;
+    }
+}
+
+// Trampolines call the simplest signatures directly instead of through libffi: up to 4 args, each
+// an integer/pointer or a double, returning nothing, an integer/pointer or a double. These ABIs pass
+// integers and doubles in separate register files, so a trampoline need only agree with the callee on
+// each arg's class; args are widened per their declared type first (see cif_word) and results
+// narrowed after (see cif_plan_call). Anything else, or any other ABI, goes through ffi_call.
+#if defined(__x86_64__) || defined(__aarch64__)
+#define CIF_TRAMPOLINES
+
+#define CIF_T_v void
+#define CIF_T_i long long
+#define CIF_T_d double
+#define CIF_R_v(call) call
+#define CIF_R_i(call) ret->i=call
+#define CIF_R_d(call) ret->d=call
+
+#define CIF_TRAMP0(r)          static void cif_tramp_##r(void *fn,CIF_WORD *a,CIF_WORD *ret)                { CIF_R_##r(((CIF_T_##r (*)(void)) fn)()); }
+#define CIF_TRAMP1(r,a0)       static void cif_tramp_##r##a0(void *fn,CIF_WORD *a,CIF_WORD *ret)            { CIF_R_##r(((CIF_T_##r (*)(CIF_T_##a0)) fn)(a[0].a0)); }
+#define CIF_TRAMP2(r,a0,a1)    static void cif_tramp_##r##a0##a1(void *fn,CIF_WORD *a,CIF_WORD *ret)        { CIF_R_##r(((CIF_T_##r (*)(CIF_T_##a0,CIF_T_##a1)) fn)(a[0].a0,a[1].a1)); }
+#define CIF_TRAMP3(r,a0,a1,a2) static void cif_tramp_##r##a0##a1##a2(void *fn,CIF_WORD *a,CIF_WORD *ret)    { CIF_R_##r(((CIF_T_##r (*)(CIF_T_##a0,CIF_T_##a1,CIF_T_##a2)) fn)(a[0].a0,a[1].a1,a[2].a2)); }
+#define CIF_TRAMP4(r,a0,a1,a2,a3) static void cif_tramp_##r##a0##a1##a2##a3(void *fn,CIF_WORD *a,CIF_WORD *ret) { CIF_R_##r(((CIF_T_##r (*)(CIF_T_##a0,CIF_T_##a1,CIF_T_##a2,CIF_T_##a3)) fn)(a[0].a0,a[1].a1,a[2].a2,a[3].a3)); }
+
+#define CIF_NAME0(r)             cif_tramp_##r,
+#define CIF_NAME1(r,a0)          cif_tramp_##r##a0,
+#define CIF_NAME2(r,a0,a1)       cif_tramp_##r##a0##a1,
+#define CIF_NAME3(r,a0,a1,a2)    cif_tramp_##r##a0##a1##a2,
+#define CIF_NAME4(r,a0,a1,a2,a3) cif_tramp_##r##a0##a1##a2##a3,
+
+// every signature, by arity and then by pattern (arg n a double if bit n set)
+#define CIF_SIGNATURES(X,r)                                                                                     \
+    X##0(r)                                                                                                     \
+    X##1(r,i) X##1(r,d)                                                                                         \
+    X##2(r,i,i) X##2(r,d,i) X##2(r,i,d) X##2(r,d,d)                                                             \
+    X##3(r,i,i,i) X##3(r,d,i,i) X##3(r,i,d,i) X##3(r,d,d,i) X##3(r,i,i,d) X##3(r,d,i,d) X##3(r,i,d,d) X##3(r,d,d,d) \
+    X##4(r,i,i,i,i) X##4(r,d,i,i,i) X##4(r,i,d,i,i) X##4(r,d,d,i,i) X##4(r,i,i,d,i) X##4(r,d,i,d,i) X##4(r,i,d,d,i) X##4(r,d,d,d,i) \
+    X##4(r,i,i,i,d) X##4(r,d,i,i,d) X##4(r,i,d,i,d) X##4(r,d,d,i,d) X##4(r,i,i,d,d) X##4(r,d,i,d,d) X##4(r,i,d,d,d) X##4(r,d,d,d,d)
+
+CIF_SIGNATURES(CIF_TRAMP,v)
+CIF_SIGNATURES(CIF_TRAMP,i)
+CIF_SIGNATURES(CIF_TRAMP,d)
+
+static CIF_TRAMPOLINE cif_trampolines[3][31]={ // [void/int/double result][(1<<arity)-1+pattern]
+    { CIF_SIGNATURES(CIF_NAME,v) },
+    { CIF_SIGNATURES(CIF_NAME,i) },
+    { CIF_SIGNATURES(CIF_NAME,d) },
+};
+#endif
+
+static int cif_class(TYPE_UTYPE utype) { return utype&(TYPE_INTS|TYPE_INTU)?1:utype==TYPE_FLOAT8?2:0; } // int, double or neither
+
+static CIF_TRAMPOLINE cif_trampoline(CIF_PLAN *plan)
+{
+#ifdef CIF_TRAMPOLINES
+    int pattern=0,result=plan->rtype==TYPE_NONE?0:cif_class(plan->rtype);
+    if (!plan->fast || plan->arity>4 || (plan->rtype!=TYPE_NONE && !result))
+        return NULL;
+    for (int i=0;i<plan->arity;i++) {
+        switch (cif_class(plan->arg[i].utype)) {
+            case 1: break;
+            case 2: pattern|=1<<i; break;
+            default: return NULL;
+        }
+    }
+    return cif_trampolines[result][(1<<plan->arity)-1+pattern];
+#else
+    return NULL;
+#endif
+}
+
+static CIF_WORD cif_word(TYPE_UTYPE utype,void *arg) // widen an arg per its declared type
+{
+    CIF_WORD word={};
+    switch(utype) {
+        case TYPE_INT1S:  word.i=*(signed char *) arg;        break;
+        case TYPE_INT2S:  word.i=*(short *) arg;              break;
+        case TYPE_INT4S:  word.i=*(int *) arg;                break;
+        case TYPE_INT8S:  word.i=*(long long *) arg;          break;
+        case TYPE_INT1U:  word.i=*(unsigned char *) arg;      break;
+        case TYPE_INT2U:  word.i=*(unsigned short *) arg;     break;
+        case TYPE_INT4U:  word.i=*(unsigned int *) arg;       break;
+        case TYPE_INT8U:  word.i=*(unsigned long long *) arg; break;
+        case TYPE_ADDR:   word.i=(long long) *(void **) arg;  break;
+        case TYPE_FLOAT4: word.d=*(float *) arg;              break; // (not passed by trampolines)
+        case TYPE_FLOAT8: word.d=*(double *) arg;             break;
+        default: break;
+    }
+    return word;
+}
+
+// A function's call plan is compiled once from its prepped cif and cached next to it. Planned calls
+// coerce args straight into this thread's frame and hand back native numbers, so e.g. int_add(a b)
+// creates no rval cvar, no coerced-arg cvars and no arg list. ffi_call copies args before entering
+// the callee, so a callback that makes its own planned call can reuse the frame.
+static __thread struct {
+    void *args[CIF_PLAN_ARGS];
+    TYPE_UVALUE slot[CIF_PLAN_ARGS];
+} cif_frame;
+
+CIF_PLAN *cif_ffi_plan(LTV *lambda)
+{
+    int status=0;
+    LTV *plan_ltv=NULL,*cif_ltv=NULL,*return_type=NULL;
+    CIF_PLAN *plan=NULL;
+
+    if ((plan_ltv=LT_get(lambda,FFI_PLAN,HEAD,KEEP)))
+        goto done;
+    STRY(!(cif_ltv=cif_ffi_prep(lambda)),"prep cif");
+    plan=NEW(CIF_PLAN);
+    plan->cif=(ffi_cif *) cif_ltv->data;
+    plan->fast=plan->cif->nargs<=CIF_PLAN_ARGS;
+    plan->fast&=!LT_get(lambda,TYPE_VARARGS,HEAD,KEEP); // a variadic callee can't be called through a fixed prototype (trampolines); leave it to ffi_call
+    if ((return_type=LT_get(lambda,TYPE_BASE,HEAD,KEEP))) { // results convert as cif_coerce_c2i would
+        plan->result=return_type=cif_find_concrete(return_type);
+        plan->rtype=return_type && ((TYPE_INFO_LTV *) return_type)->tag==DW_TAG_base_type?Type_utype(return_type):TYPE_NONE;
+        plan->fast&=plan->rtype!=TYPE_NONE && plan->rtype!=TYPE_FLOAT16; // other results stay cvars; leave them to cif_ffi_call
+    }
+
+    int planner(char *name,LTV *type) {
+        if (plan->arity>=CIF_PLAN_ARGS) {
+            plan->fast=0;
+            return 0;
+        }
+        LTV *concrete=cif_find_concrete(type);
+        char *type_name=attr_get(concrete,TYPE_SYMB);
+        int match(char *key) { return type_name && !strcmp(key,type_name); }
+        plan->arg[plan->arity].type=type;
+        plan->arg[plan->arity].concrete=concrete;
+        plan->arg[plan->arity].utype=Type_utype(concrete); // pointers read as ints too (see cif_word)
+        if (match("(LTV)*"))
+            plan->arg[plan->arity].kind=CIF_ARG_LTV;
+        else if (match("(char)*") || match("(unsigned char)*"))
+            plan->arg[plan->arity].kind=CIF_ARG_STRING;
+        else if (is_readable(concrete) && plan->arg[plan->arity].utype)
+            plan->arg[plan->arity].kind=CIF_ARG_SCALAR;
+        else
+            plan->arg[plan->arity].kind=CIF_ARG_CVAR;
+        plan->arity++;
+        return 0;
+    };
+    STRY(cif_args_marshal(lambda,FWD,planner),"plan ffi args");
+    plan->fast&=plan->arity==plan->cif->nargs;
+    plan->trampoline=cif_trampoline(plan);
+    STRY(!(plan_ltv=LTV_init(NEW(LTV),plan,sizeof(CIF_PLAN),LT_OWN|LT_BIN)),"wrap call plan");
+    plan=NULL;
+    STRY(!LT_put(lambda,FFI_PLAN,HEAD,plan_ltv),"cache call plan");
+ done:
+    DELETE(plan);
+    if (status) {
+        LTV_release(plan_ltv);
+        plan_ltv=NULL;
+    }
+    return plan_ltv && ((CIF_PLAN *) plan_ltv->data)->fast?(CIF_PLAN *) plan_ltv->data:NULL;
+}
+
+typedef union { ffi_arg u; ffi_sarg s; float f; double d; CIF_WORD word; } CIF_RET;
+
+static int cif_plan_arg(CIF_PLAN *plan,int i,LTV *arg,CLL *coerced) // place arg i in the frame
+{
+    int status=0;
+    TYPE_UVALUE *slot=&cif_frame.slot[i];
+    if (arg->flags&LT_CVAR) {
+        if (LT_get(arg,TYPE_BASE,HEAD,KEEP)!=plan->arg[i].concrete)
+            goto coerce;
+    } else switch (plan->arg[i].kind) {
+        case CIF_ARG_SCALAR:
+            BZERO(*slot);
+            slot->base.dutype=plan->arg[i].utype;
+            if (arg->flags&LT_NUM)
+                Type_immUVAL(slot,arg);
+            else
+                Type_pullUVAL(slot,arg->data);
+            cif_frame.args[i]=Type_UVALdata(slot);
+            goto done;
+        case CIF_ARG_STRING:
+            if (arg->flags&LT_NUM) // needs text rendered
+                goto coerce;
+            cif_frame.args[i]=&arg->data;
+            goto done;
+        case CIF_ARG_LTV:
+            slot->addr.val=arg;
+            cif_frame.args[i]=&slot->addr.val;
+            goto done;
+        default:
+            goto coerce;
+    }
+    cif_frame.args[i]=(arg->flags&LT_ARR)?&arg->data:arg->data;
+    goto done;
+ coerce: // the plan couldn't place it directly
+    STRY(!(arg=cif_coerce_i2c(arg,plan->arg[i].type)),"coercing ffi arg %d",i);
+    LTV_enq(coerced,arg,HEAD);
+    cif_frame.args[i]=(arg->flags&LT_ARR)?&arg->data:arg->data;
+ done:
+    return status;
+}
+
+static void cif_plan_invoke(CIF_PLAN *plan,void *loc,CIF_RET *ret) // call with the args in the frame
+{
+    if (plan->trampoline) {
+        CIF_WORD word[4];
+        for (int i=0;i<plan->arity;i++)
+            word[i]=cif_word(plan->arg[i].utype,cif_frame.args[i]);
+        plan->trampoline(loc,word,&ret->word);
+    } else
+        ffi_call(plan->cif,loc,ret,cif_frame.args);
+}
+
+int cif_plan_call(CIF_PLAN *plan,void *loc,LTV **argv,LTV **result)
+{
+    int status=0;
+    CLL coerced; CLL_init(&coerced);
+    CIF_RET ret={};
+
+    for (int i=0;i<plan->arity;i++)
+        STRY(cif_plan_arg(plan,i,argv[i],&coerced),"place ffi arg %d",i);
+    cif_plan_invoke(plan,loc,&ret);
+
+    switch (plan->rtype) {
+        case TYPE_INT1S:  *result=LTV_I64((signed char) ret.s);        break;
+        case TYPE_INT2S:  *result=LTV_I64((short) ret.s);              break;
+        case TYPE_INT4S:  *result=LTV_I64((int) ret.s);                break;
+        case TYPE_INT8S:  *result=LTV_I64((long long) ret.s);          break;
+        case TYPE_INT1U:  *result=LTV_I64((unsigned char) ret.u);      break;
+        case TYPE_INT2U:  *result=LTV_I64((unsigned short) ret.u);     break;
+        case TYPE_INT4U:  *result=LTV_I64((unsigned int) ret.u);       break;
+        case TYPE_INT8U:  *result=LTV_I64((unsigned long long) ret.u); break; // same bits; coerces back intact
+        case TYPE_FLOAT4: *result=LTV_F64(ret.f);                      break;
+        case TYPE_FLOAT8: *result=LTV_F64(ret.d);                      break;
+        default:          *result=NULL;                                break;
+    }
+ done:
+    CLL_release(&coerced,LTVR_release);
+    return status;
+}
+
+// Apply a planned function across equal-length sequences, one per parameter: lists (each element
+// placed as a single call's arg would be), C arrays, or earlier results. The results are written
+// into one C array, returned as a "(T)*" cvar that counts its elements (TYPE_COUNT).
+int cif_plan_map(CIF_PLAN *plan,void *loc,LTV **argv,LTV **result)
+{
+    int status=0,n=-1,rsize=0;
+    CLL coerced; CLL_init(&coerced);
+    LTV **elems[CIF_PLAN_ARGS]={};   // list args, flattened
+    char *base[CIF_PLAN_ARGS]={};    // array args' first elements...
+    int size[CIF_PLAN_ARGS]={};      // ...sizes...
+    TYPE_UTYPE utype[CIF_PLAN_ARGS]={}; // ...and kinds
+    int direct[CIF_PLAN_ARGS]={};    // array arg's elements are already of the parameter's type
+    char *out=NULL;
+
+    *result=NULL;
+    STRY(!plan->arity,"validate mapped function has args");
+    for (int i=0;i<plan->arity;i++) {
+        LTV *arg=argv[i],*count=NULL;
+        int len=0;
+        if (arg->flags&LT_LIST) {
+            CLL *ltvs=LTV_list(arg);
+            len=LTV_len(ltvs);
+            STRY(!(elems[i]=(LTV **) mymalloc(sizeof(LTV *)*(len+1))),"flatten arg %d",i);
+            int k=0;
+            void *flatten(LTV *ltv) { elems[i][k++]=ltv; return NULL; };
+            LTV_each(ltvs,FWD,flatten);
+        } else if (arg->flags&LT_CVAR) {
+            LTV *type=NULL,*elem_type=NULL;
+            STRY(!(type=cif_find_concrete(LT_get(arg,TYPE_BASE,HEAD,KEEP))),"resolve arg %d type",i);
+            STRY(!(elem_type=cif_find_concrete(LT_get(type,TYPE_BASE,HEAD,KEEP))),"resolve arg %d element type",i);
+            STRY(!(size[i]=((TYPE_INFO_LTV *) elem_type)->bytesize),"size arg %d elements",i);
+            if (((TYPE_INFO_LTV *) type)->tag==DW_TAG_array_type && (arg->flags&LT_ARR)) {
+                base[i]=(char *) arg->data;
+                len=((TYPE_INFO_LTV *) type)->bytesize/size[i];
+            } else if (((TYPE_INFO_LTV *) type)->tag==DW_TAG_pointer_type && (count=LT_get(arg,TYPE_COUNT,HEAD,KEEP))) {
+                base[i]=*(char **) arg->data;
+                len=LTV_INT(count);
+            } else
+                STRY(1,"validate arg %d is an array",i);
+            utype[i]=Type_utype(elem_type);
+            direct[i]=elem_type==plan->arg[i].concrete || (utype[i] && utype[i]==plan->arg[i].utype);
+            STRY(!direct[i] && (plan->arg[i].kind!=CIF_ARG_SCALAR || !utype[i] || utype[i]==TYPE_FLOAT16),"convert arg %d elements",i);
+        } else
+            STRY(1,"validate arg %d is a list or array",i);
+        STRY(n>=0 && len!=n,"match arg %d length %d to %d",i,len,n);
+        n=len;
+    }
+
+    if (plan->result) { // a pointer, then the elements it points to
+        LTV *meta=NULL;
+        STRY(!(meta=cif_get_meta(plan->result)),"find result pointer type");
+        rsize=((TYPE_INFO_LTV *) plan->result)->bytesize;
+        STRY(!(out=(char *) mymalloc(sizeof(void *)+n*rsize)),"allocate results");
+        *(void **) out=out+sizeof(void *);
+        STRY(!(*result=LTV_init(NEW(LTV),out,sizeof(void *),LT_OWN|LT_BIN|LT_CVAR)),"wrap results");
+        out+=sizeof(void *);
+        LT_put(*result,TYPE_BASE,HEAD,meta);
+        LT_put(*result,TYPE_COUNT,HEAD,LTV_I64(n));
+    }
+
+    for (int k=0;k<n;k++) {
+        CIF_RET ret={};
+        for (int i=0;i<plan->arity;i++) {
+            if (elems[i])
+                STRY(cif_plan_arg(plan,i,elems[i][k],&coerced),"place ffi arg %d of element %d",i,k);
+            else if (direct[i])
+                cif_frame.args[i]=base[i]+k*size[i];
+            else { // convert element into the parameter's kind
+                CIF_WORD word=cif_word(utype[i],base[i]+k*size[i]);
+                int real=utype[i]&TYPE_FLOAT;
+                TYPE_UVALUE *slot=&cif_frame.slot[i];
+                BZERO(*slot);
+                slot->base.dutype=plan->arg[i].utype;
+                Type_numUVAL(slot,real?(long long) word.d:word.i,real?word.d:(double) word.i);
+                cif_frame.args[i]=Type_UVALdata(slot);
+            }
+        }
+        cif_plan_invoke(plan,loc,&ret);
+        if (out) {
+            void *dst=out+k*rsize;
+            switch (plan->rtype) {
+                case TYPE_INT1S:  *(signed char *) dst=ret.s;        break;
+                case TYPE_INT2S:  *(short *) dst=ret.s;              break;
+                case TYPE_INT4S:  *(int *) dst=ret.s;                break;
+                case TYPE_INT8S:  *(long long *) dst=ret.s;          break;
+                case TYPE_INT1U:  *(unsigned char *) dst=ret.u;      break;
+                case TYPE_INT2U:  *(unsigned short *) dst=ret.u;     break;
+                case TYPE_INT4U:  *(unsigned int *) dst=ret.u;       break;
+                case TYPE_INT8U:  *(unsigned long long *) dst=ret.u; break;
+                case TYPE_FLOAT4: *(float *) dst=ret.f;              break;
+                case TYPE_FLOAT8: *(double *) dst=ret.d;             break;
+                default: break;
+            }
+        }
+        CLL_release(&coerced,LTVR_release);
+    }
+
+ done:
+    CLL_release(&coerced,LTVR_release);
+    for (int i=0;i<CIF_PLAN_ARGS;i++)
+        DELETE(elems[i]);
+    if (status && *result) {
+        LTV_release(*result);
+        *result=NULL;
+    } else if (status && out) // never wrapped
+        DELETE(out);
+    return status;
+}
+
+// cif_plan_map for what a plan can't take (non-scalar results, too many args, no "(T)*" meta): every call
+// goes through cif_ffi_call, array elements are passed as cvars, and the results are listed as vm_ffi pushes them.
+int cif_ffi_map(LTV *lambda,void *loc,LTV **argv,int arity,LTV **result)
+{
+    int status=0,n=-1;
+    LTV *cif=NULL,*list=NULL;
+    LTV **elems[arity];    // list args, flattened
+    LTV *elem_type[arity]; // array args' element types...
+    char *base[arity];     // ...first elements...
+    int size[arity];       // ...and sizes
+
+    *result=NULL;
+    for (int i=0;i<arity;i++)
+        elems[i]=NULL,elem_type[i]=NULL;
+    STRY(!arity,"validate mapped function has args");
+    STRY(!(cif=cif_ffi_prep(lambda)),"prep cif");
+    for (int i=0;i<arity;i++) {
+        LTV *arg=argv[i],*count=NULL,*type=NULL;
+        int len=0;
+        if (arg->flags&LT_LIST) {
+            CLL *ltvs=LTV_list(arg);
+            len=LTV_len(ltvs);
+            STRY(!(elems[i]=(LTV **) mymalloc(sizeof(LTV *)*(len+1))),"flatten arg %d",i);
+            int k=0;
+            void *flatten(LTV *ltv) { elems[i][k++]=ltv; return NULL; };
+            LTV_each(ltvs,FWD,flatten);
+        } else if (arg->flags&LT_CVAR) {
+            STRY(!(type=cif_find_concrete(LT_get(arg,TYPE_BASE,HEAD,KEEP))),"resolve arg %d type",i);
+            STRY(!(elem_type[i]=LT_get(type,TYPE_BASE,HEAD,KEEP)),"resolve arg %d element type",i);
+            STRY(!(size[i]=((TYPE_INFO_LTV *) cif_find_concrete(elem_type[i]))->bytesize),"size arg %d elements",i);
+            if (((TYPE_INFO_LTV *) type)->tag==DW_TAG_array_type && (arg->flags&LT_ARR)) {
+                base[i]=(char *) arg->data;
+                len=((TYPE_INFO_LTV *) type)->bytesize/size[i];
+            } else if (((TYPE_INFO_LTV *) type)->tag==DW_TAG_pointer_type && (count=LT_get(arg,TYPE_COUNT,HEAD,KEEP))) {
+                base[i]=*(char **) arg->data;
+                len=LTV_INT(count);
+            } else
+                STRY(1,"validate arg %d is an array",i);
+        } else
+            STRY(1,"validate arg %d is a list or array",i);
+        STRY(n>=0 && len!=n,"match arg %d length %d to %d",i,len,n);
+        n=len;
+    }
+
+    for (int k=0;k<n;k++) {
+        CLL args; CLL_init(&args);
+        LTV *rval=cif_rval_create(lambda,NULL);
+        int i=0,void_func=!rval;
+        if (void_func)
+            rval=LTV_NULL;
+        int marshaller(char *name,LTV *type) {
+            int status=0;
+            LTV *arg=NULL,*coerced=NULL;
+            if (elems[i])
+                arg=elems[i][k];
+            else
+                STRY(!(arg=cif_create_cvar(elem_type[i],base[i]+k*size[i],NULL)),"reference arg %d element %d",i,k);
+            STRY(!(coerced=cif_coerce_i2c(arg,type)),"coercing ffi arg (%s) of element %d",name,k);
+            LTV_enq(&args,coerced,TAIL);
+            LT_put(rval,name,HEAD,coerced); // as in vm_ffi
+        done:
+            if (arg && !elems[i])
+                LTV_release(arg);
+            i++;
+            return status;
+        }
+        if (!(status=cif_args_marshal(lambda,FWD,marshaller)))
+            status=cif_ffi_call(cif,loc,rval,&args);
+        if (status || void_func)
+            LTV_release(rval);
+        else {
+            if (!list)
+                list=LTV_NULL_LIST;
+            LTV_enq(LTV_list(list),cif_coerce_c2i(rval),TAIL);
+        }
+        CLL_release(&args,LTVR_release);
+        STRY(status,"call mapped function on element %d",k);
+    }
+    *result=list;
+    list=NULL;
+ done:
+    LTV_release(list);
+    for (int i=0;i<arity;i++)
+        DELETE(elems[i]);
+    return status;
+}
+
 LTV *cif_type_info(char *type_name) { return LT_get(cif_module,type_name,HEAD,KEEP); }
 
 
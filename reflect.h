@@ -62,11 +62,16 @@
 #define TYPE_LINK "die link" // a cu's mangled linkage name
 #define TYPE_BASE "die base" // a die's base's ltv
 #define TYPE_LIST "die list" // type's children, in die order
+#define TYPE_VARARGS "unspecified parameters" // a variadic function's trailing "..."
 #define TYPE_CAST "die cast" // a casted cvar's original data (lifespan protection)
 #define TYPE_META "die meta" // a die's pointer-type parent
+#define TYPE_COUNT "die count" // elements behind a pointer cvar (see cif_plan_map)
+
+#define MODULE_LAZY "module lazy" // lazily imported module's uncurated CUs, each listing its names
 
 #define FFI_TYPE  "ffi type"  // FFI data assocated with type
 #define FFI_CIF   "ffi cif"   // FFI data assocated with type
+#define FFI_PLAN  "ffi plan"  // call plan associated with function type (see cif_ffi_plan)
 
 #define DIE_FORMAT "\"%s\""       // format for a die's DOT-language element id
 #define CVAR_FORMAT "\"CVAR_%x\"" // format for a CVAR's DOT-language element id
@@ -180,6 +185,34 @@ typedef struct
     Dwarf_Sig8 sig8; // used in dwarf v4
 } TYPE_INFO_LTV;
 
+typedef enum {
+    CIF_ARG_CVAR,   // only a cvar of the parameter's own type passes as-is
+    CIF_ARG_SCALAR, // native numbers and text convert straight into the frame
+    CIF_ARG_STRING, // (char)*: an LTV's data
+    CIF_ARG_LTV,    // (LTV)*: the LTV itself
+} CIF_ARG_KIND;
+
+#define CIF_PLAN_ARGS 16 // most args a planned call takes; more go through cif_ffi_call
+
+typedef union { long long i; double d; } CIF_WORD; // an arg or result, widened to its register
+typedef void (*CIF_TRAMPOLINE)(void *fn,CIF_WORD *args,CIF_WORD *ret);
+
+typedef struct
+{
+    ffi_cif *cif;
+    int arity;
+    int fast;           // signature can be called through cif_plan_call
+    TYPE_UTYPE rtype;   // TYPE_NONE for void
+    LTV *result;        // concrete result type, NULL for void
+    CIF_TRAMPOLINE trampoline; // direct call for simple signatures, else NULL (ffi_call)
+    struct {
+        LTV *type;      // as cif_args_marshal presents it
+        LTV *concrete;
+        CIF_ARG_KIND kind;
+        TYPE_UTYPE utype;
+    } arg[CIF_PLAN_ARGS];
+} CIF_PLAN;
+
 extern LTV *cif_module;
 
 void cif_init(int bootstrap);
@@ -191,6 +224,8 @@ extern int cif_dot_cvar(FILE *ofile,LTV *ltv);
 
 extern int cif_preview_module(LTV *mod_ltv);
 extern int cif_import_module(LTV *mod_ltv);
+extern int cif_lazy_import_module(LTV *mod_ltv); // index names only; curate each CU on first lookup
+extern int cif_import_verify(LTV *mod_ltv); // curate in parallel and serially, time both, and compare (see importbench)
 
 extern LTV *cif_ffi_prep(LTV *lambda);
 extern LTV *cif_rval_create(LTV *lambda,void *data);
@@ -199,6 +234,10 @@ extern LTV *cif_put_meta(LTV *ltv,LTV *meta);
 extern LTV *cif_coerce_i2c(LTV *arg,LTV *type);
 extern LTV *cif_coerce_c2i(LTV *arg);
 extern int cif_ffi_call(LTV *type,void *loc,LTV *rval,CLL *coerced_ltvs);
+extern CIF_PLAN *cif_ffi_plan(LTV *lambda); // NULL unless lambda's signature can take the planned path
+extern int cif_plan_call(CIF_PLAN *plan,void *loc,LTV **argv,LTV **result); // argv in parameter order; *result NULL if void
+extern int cif_plan_map(CIF_PLAN *plan,void *loc,LTV **argv,LTV **result); // argv: a list or array per parameter
+extern int cif_ffi_map(LTV *lambda,void *loc,LTV **argv,int arity,LTV **result); // unplanned; results come back listed
 
 extern int cif_args_marshal(LTV *lambda,int dir,int (*marshal)(char *argname,LTV *type));
 
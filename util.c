@@ -38,12 +38,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h> // offsetof
 #include <fnmatch.h>
+#include <pthread.h>
 #include "util.h"
 
 #include "trace.h" // lttng
 
-int Gmymalloc=0;
+int Gslab=1;
 
 int try_depth=0;
 int try_loglev=2;
@@ -108,25 +110,180 @@ void try_reset() {
 
 void *mymalloc(int size) {
     void *r=calloc(size,1);
-    if (r) Gmymalloc+=1;
+    if (r) STAT_ADD(STAT_MALLOC,1);
     TALLOC(r,size,"");
     return r;
 }
 
 void *myrealloc(void *buf, int newsize) {
     void *r=realloc(buf,newsize);
-    if (r) Gmymalloc+=1;
+    if (r && !buf) STAT_ADD(STAT_MALLOC,1);
     TDEALLOC(buf,"");
     TALLOC(r,newsize,"");
     return r;
 }
 
 void myfree(void *p,int size) {
-    if (p) Gmymalloc-=1;
+    if (p) STAT_ADD(STAT_MALLOC,-1);
     free(p);
     TDEALLOC(p,"");
 }
 
+//////////////////////////////////////////////////
+// Statistics counters
+//////////////////////////////////////////////////
+
+__thread STAT_SHARD stat_shard;
+static STAT_SHARD stat_shards={.next=&stat_shards,.prev=&stat_shards}; // ring of live shards; count[] holds exited threads' totals
+static pthread_mutex_t stat_mutex=PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t stat_key;
+static pthread_once_t stat_once=PTHREAD_ONCE_INIT;
+
+static void stat_thread_exit(void *shard) { // fold a dying thread's shard into the retired totals
+    STAT_SHARD *s=(STAT_SHARD *) shard;
+    pthread_mutex_lock(&stat_mutex);
+    for (int i=0;i<STAT_COUNTERS;i++)
+        stat_shards.count[i]+=s->count[i],s->count[i]=0;
+    s->prev->next=s->next;
+    s->next->prev=s->prev;
+    s->registered=0; // a later bump (e.g. from another destructor) re-registers
+    pthread_mutex_unlock(&stat_mutex);
+}
+
+static void stat_init() { pthread_key_create(&stat_key,stat_thread_exit); }
+
+void stat_register() {
+    pthread_once(&stat_once,stat_init);
+    pthread_mutex_lock(&stat_mutex);
+    stat_shard.next=stat_shards.next;
+    stat_shard.prev=&stat_shards;
+    stat_shards.next->prev=&stat_shard;
+    stat_shards.next=&stat_shard;
+    stat_shard.registered=1;
+    pthread_mutex_unlock(&stat_mutex);
+    pthread_setspecific(stat_key,(void *) &stat_shard);
+}
+
+long stat_read(STAT_COUNTER counter) {
+    pthread_mutex_lock(&stat_mutex);
+    long sum=stat_shards.count[counter];
+    for (STAT_SHARD *s=stat_shards.next;s!=&stat_shards;s=s->next)
+        sum+=__atomic_load_n(&s->count[counter],__ATOMIC_RELAXED);
+    pthread_mutex_unlock(&stat_mutex);
+    return sum;
+}
+
+//////////////////////////////////////////////////
+// Slab allocator
+//////////////////////////////////////////////////
+
+typedef struct SLAB_NODE { struct SLAB_NODE *next; } SLAB_NODE;
+
+typedef struct {
+    SLAB_NODE head;
+    int count;
+} SLAB_LIST;
+
+static SLAB_LIST slab_depot[SLAB_CLASSES];
+static pthread_mutex_t slab_mutex=PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t slab_key;
+static pthread_once_t slab_once=PTHREAD_ONCE_INIT;
+static int slab_enabled=-1; // latched on first use so blocks never cross allocators
+
+static __thread SLAB_LIST slab_cache[SLAB_CLASSES];
+static __thread int slab_registered=0;
+
+static void slab_move(SLAB_LIST *dst,SLAB_LIST *src,int count) {
+    SLAB_NODE *iter,*node;
+    while (count-- && (node=STACK_NEWITER(iter,&src->head)) && STACK_POP(iter)) {
+        (void) STACK_PUSH(&dst->head,node);
+        dst->count++,src->count--;
+    }
+}
+
+static void slab_thread_exit(void *unused) { // hand a dying thread's cache back to the depot
+    pthread_mutex_lock(&slab_mutex);
+    for (int i=0;i<SLAB_CLASSES;i++)
+        slab_move(&slab_depot[i],&slab_cache[i],slab_cache[i].count);
+    pthread_mutex_unlock(&slab_mutex);
+}
+
+static void slab_init() {
+    pthread_key_create(&slab_key,slab_thread_exit);
+    __atomic_store_n(&slab_enabled,Gslab && !getenv("J2_NOSLAB"),__ATOMIC_RELEASE);
+}
+
+static int slab_on() { // pthread_once only until the latch is visible
+    int enabled=__atomic_load_n(&slab_enabled,__ATOMIC_ACQUIRE);
+    if (enabled<0) {
+        pthread_once(&slab_once,slab_init);
+        enabled=slab_enabled;
+    }
+    return enabled;
+}
+
+static void slab_register(SLAB_LIST *cache) { // only needed so the destructor fires at thread exit
+    if (!slab_registered)
+        slab_registered=!pthread_setspecific(slab_key,(void *) cache);
+}
+
+static int slab_class(int size) { return (size-1)/SLAB_QUANTUM; }
+
+static void slab_refill(SLAB_LIST *cache,int class) {
+    slab_register(cache);
+
+    pthread_mutex_lock(&slab_mutex);
+    slab_move(cache,&slab_depot[class],SLAB_BATCH);
+    if (!cache->count) { // depot was dry; carve a fresh chunk
+        int size=(class+1)*SLAB_QUANTUM;
+        char *chunk=mymalloc(SLAB_CHUNK);
+        for (int offset=0;chunk && offset+size<=SLAB_CHUNK;offset+=size) {
+            (void) STACK_PUSH(&cache->head,(SLAB_NODE *) (chunk+offset));
+            cache->count++;
+        }
+    }
+    pthread_mutex_unlock(&slab_mutex);
+}
+
+void *slab_alloc(int size) {
+    if (!slab_on() || size>SLAB_QUANTUM*SLAB_CLASSES)
+        return mymalloc(size);
+
+    int class=slab_class(size);
+    SLAB_LIST *cache=&slab_cache[class];
+    SLAB_NODE *iter,*node;
+    if (!cache->count)
+        slab_refill(cache,class);
+    if (!(node=STACK_NEWITER(iter,&cache->head)))
+        return NULL;
+    STACK_POP(iter);
+    cache->count--;
+    STAT_ADD(STAT_MALLOC,1);
+    TALLOC(node,size,"slab");
+    return (void *) node;
+}
+
+// p must come from slab_alloc(size); anything else (e.g. a derived LTV) goes to myfree
+void slab_free(void *p,int size) {
+    if (!p) return;
+    if (!slab_on() || size>SLAB_QUANTUM*SLAB_CLASSES) {
+        myfree(p,size);
+        return;
+    }
+
+    int class=slab_class(size);
+    SLAB_LIST *cache=&slab_cache[class];
+    slab_register(cache); // a thread that only frees (e.g. the reclaimer) must still hand its cache back
+    (void) STACK_PUSH(&cache->head,(SLAB_NODE *) p);
+    STAT_ADD(STAT_MALLOC,-1);
+    TDEALLOC(p,"slab");
+    if (++cache->count>SLAB_BATCH*2) {
+        pthread_mutex_lock(&slab_mutex);
+        slab_move(&slab_depot[class],cache,SLAB_BATCH);
+        pthread_mutex_unlock(&slab_mutex);
+    }
+}
+
 void *mybzero(void *buf,int size) { return buf?memset(buf,0,size):NULL; }
 
 char *strstrip(char *buf,int *len) {
@@ -170,6 +327,162 @@ char *bufdup(const char *buf,int len) {
 
 char *stripdup(char *buf,int *len) { return strstrip(bufdup(buf,*len),len); }
 
+//////////////////////////////////////////////////
+// String interning
+//////////////////////////////////////////////////
+
+typedef struct INTERN {
+    struct INTERN *next;
+    unsigned hash;
+    int refs;
+    int len;
+    char str[];
+} INTERN;
+
+#define INTERN_OF(s) ((INTERN *) ((s)-offsetof(INTERN,str)))
+
+static INTERN **intern_bucket=NULL;
+static unsigned intern_buckets=0,intern_count=0;
+static pthread_mutex_t intern_mutex=PTHREAD_MUTEX_INITIALIZER;
+
+unsigned strnhash(const char *buf,int len) { // FNV-1a
+    unsigned hash=2166136261u;
+    if (len<0) len=strlen(buf);
+    while (len--)
+        hash=(hash^(unsigned char) *buf++)*16777619u;
+    return hash;
+}
+
+static void intern_grow() {
+    unsigned buckets=intern_buckets?intern_buckets*2:1024;
+    INTERN **bucket=(INTERN **) mymalloc(buckets*sizeof(INTERN *));
+    if (!bucket)
+        return;
+    for (unsigned i=0;i<intern_buckets;i++) {
+        for (INTERN *next,*entry=intern_bucket[i];entry;entry=next) {
+            next=entry->next;
+            entry->next=bucket[entry->hash&(buckets-1)];
+            bucket[entry->hash&(buckets-1)]=entry;
+        }
+    }
+    DELETE(intern_bucket);
+    intern_bucket=bucket;
+    intern_buckets=buckets;
+}
+
+char *strintern(const char *buf,int len) {
+    INTERN *entry=NULL;
+    if (len<0) len=strlen(buf);
+    unsigned hash=strnhash(buf,len);
+
+    pthread_mutex_lock(&intern_mutex);
+    if (intern_count>=intern_buckets)
+        intern_grow();
+    if (!intern_bucket)
+        goto done;
+    for (entry=intern_bucket[hash&(intern_buckets-1)];entry;entry=entry->next)
+        if (entry->hash==hash && entry->len==len && !memcmp(entry->str,buf,len))
+            break;
+    if (entry)
+        entry->refs++;
+    else if ((entry=(INTERN *) mymalloc(sizeof(INTERN)+len+1))) {
+        entry->hash=hash;
+        entry->refs=1;
+        entry->len=len;
+        memcpy(entry->str,buf,len);
+        entry->str[len]=0;
+        entry->next=intern_bucket[hash&(intern_buckets-1)];
+        intern_bucket[hash&(intern_buckets-1)]=entry;
+        intern_count++;
+    }
+ done:
+    pthread_mutex_unlock(&intern_mutex);
+    return entry?entry->str:NULL;
+}
+
+void strunintern(char *str) {
+    if (!str) return;
+    INTERN *entry=INTERN_OF(str);
+    pthread_mutex_lock(&intern_mutex);
+    if (!--entry->refs) {
+        INTERN **link=&intern_bucket[entry->hash&(intern_buckets-1)];
+        while (*link!=entry)
+            link=&(*link)->next;
+        *link=entry->next;
+        intern_count--;
+        DELETE(entry);
+    }
+    pthread_mutex_unlock(&intern_mutex);
+}
+
+unsigned strinterned_hash(char *str) { return INTERN_OF(str)->hash; }
+int strinterned_len(char *str)       { return INTERN_OF(str)->len; }
+
+//////////////////////////////////////////////////
+// Pointer map
+//////////////////////////////////////////////////
+
+static unsigned ptrhash(void *key) { return (unsigned) (((uint64_t) (uintptr_t) key*0x9e3779b97f4a7c15ull)>>32); }
+
+static int ptrmap_resize(PTRMAP *map,unsigned slots) {
+    typeof(map->slot) slot=mymalloc(slots*sizeof(*slot));
+    if (!slot)
+        return 1;
+    for (unsigned i=0;map->slot && i<=map->mask;i++) {
+        if (map->slot[i].key) {
+            unsigned j=ptrhash(map->slot[i].key)&(slots-1);
+            while (slot[j].key)
+                j=(j+1)&(slots-1);
+            slot[j]=map->slot[i];
+        }
+    }
+    DELETE(map->slot);
+    map->slot=slot;
+    map->mask=slots-1;
+    return 0;
+}
+
+PTRMAP *ptrmap_init(PTRMAP *map,int size) {
+    unsigned slots=16;
+    while (slots<size*2)
+        slots*=2;
+    BZERO(*map);
+    return ptrmap_resize(map,slots)?NULL:map;
+}
+
+void ptrmap_free(PTRMAP *map) {
+    DELETE(map->slot);
+    BZERO(*map);
+}
+
+void *ptrmap_get(PTRMAP *map,void *key) {
+    if (!map->slot)
+        return NULL;
+    for (unsigned i=ptrhash(key)&map->mask;map->slot[i].key;i=(i+1)&map->mask)
+        if (map->slot[i].key==key)
+            return map->slot[i].val;
+    return NULL;
+}
+
+void *ptrmap_put(PTRMAP *map,void *key,void *val) {
+    unsigned i;
+    if ((!map->slot || (map->count+1)*2>map->mask+1) && ptrmap_resize(map,map->slot?(map->mask+1)*2:16)) // keep load under 1/2
+        return NULL;
+    for (i=ptrhash(key)&map->mask;map->slot[i].key && map->slot[i].key!=key;i=(i+1)&map->mask);
+    if (!map->slot[i].key)
+        map->count++;
+    map->slot[i].key=key;
+    return map->slot[i].val=val;
+}
+
+void *ptrmap_map(PTRMAP *map,void *(*op)(void *key,void *val)) {
+    void *rval=NULL;
+    for (unsigned i=0;map->slot && i<=map->mask && !rval;i++)
+        if (map->slot[i].key)
+            rval=op(map->slot[i].key,map->slot[i].val);
+    return rval;
+}
+
 int strtou(char *str,int len,unsigned *val) {
     char *tail;
     if (!str) return 0;
@@ -224,6 +537,45 @@ int fnmatch_len(char *pat,int plen,char *str,int slen) {
     return result;
 }
 
+GLOB *glob_compile(GLOB *glob,char *pat,int len) {
+    if (len==-1)
+        len=strlen(pat);
+    glob->pat=pat;
+    glob->len=len;
+    for (glob->prefix=0;glob->prefix<len && !strchr("*?[\\+@!(",pat[glob->prefix]);glob->prefix++);
+    glob->simple=true;
+    for (int i=glob->prefix;i<len;i++)
+        if (strchr("[\\(",pat[i]))
+            glob->simple=false;
+    return glob;
+}
+
+int glob_match(GLOB *glob,char *str,int len) {
+    if (len==-1)
+        len=strlen(str);
+    if (len<glob->prefix || memcmp(str,glob->pat,glob->prefix))
+        return FNM_NOMATCH;
+    if (!glob->simple)
+        return fnmatch_len(glob->pat,glob->len,str,len);
+
+    char *p=glob->pat+glob->prefix,*pend=glob->pat+glob->len;
+    char *s=str+glob->prefix,*send=str+len;
+    char *star=NULL,*resume=NULL; // backtrack point for the most recent '*'
+    while (s<send) {
+        if (p<pend && *p=='*')
+            star=p++,resume=s;
+        else if (p<pend && (*p=='?' || *p==*s))
+            p++,s++;
+        else if (star)
+            p=star+1,s=++resume;
+        else
+            return FNM_NOMATCH;
+    }
+    while (p<pend && *p=='*')
+        p++;
+    return p<pend?FNM_NOMATCH:0;
+}
+
 int shexdump(FILE *ofile,char *buf,int size,int width,int opts) {
     int i=0;
     int o(int i) { return opts&SHEXDUMP_OPT_REVERSE?(size-1-i):i; } // reversible offset
@@ -100,8 +100,6 @@ typedef unsigned long long ull;
 #define NON_NULL (NULL-1)
 #define PTR_OP(x,op,y) ((typeof(x)) (((uintptr_t) x) op ((uintptr_t) y)))
 
-extern int Gmymalloc;
-
 static inline int minint(int a,int b) { return MIN(a,b); }
 static inline int maxint(int a,int b) { return MAX(a,b); }
 
@@ -184,10 +182,50 @@ extern void myfree(void *p,int size);
 extern void *mybzero(void *p,int size);
 #define ZERO(x) (*(typeof(&x))mybzero(&x,sizeof(x)))
 
-#define NEW(type) ((type *) (mybzero(mymalloc(sizeof(type)),sizeof(type))))
+//////////////////////////////////////////////////
+// Size-class slab allocator for small fixed-size nodes. Each thread keeps its own free list per
+// class and trades batches with a shared depot. Chunks come from mymalloc (so STAT_MALLOC counts
+// them alongside the nodes handed out) and are never freed: detached threads and late destructors
+// may still hold slab nodes during exit, so the OS reclaims them.
+// Setting Gslab=0 (or J2_NOSLAB in the environment) before the first allocation makes every
+// slab call fall through to mymalloc/myfree, which keeps valgrind/MALLOC_CHECK useful.
+//////////////////////////////////////////////////
+#define SLAB_QUANTUM 16   // class granularity (bytes)
+#define SLAB_CLASSES 8    // classes cover 1..SLAB_QUANTUM*SLAB_CLASSES bytes
+#define SLAB_BATCH   64   // nodes moved between thread cache and depot at a time
+#define SLAB_CHUNK   (64*1024)
+
+extern int Gslab;
+
+extern void *slab_alloc(int size);
+extern void slab_free(void *p,int size);
+
+// types NEW'd/RELEASE'd through the slab: listree's nodes (they needn't be complete here)
+struct LTV; struct LTI; struct LTVR; struct REF;
+#define SLABBED(type) (__builtin_types_compatible_p(type,struct LTV)  || \
+                       __builtin_types_compatible_p(type,struct LTI)  || \
+                       __builtin_types_compatible_p(type,struct LTVR) || \
+                       __builtin_types_compatible_p(type,struct REF))
+
+#define NEW(type) ((type *) (mybzero(SLABBED(type)?slab_alloc(sizeof(type)):mymalloc(sizeof(type)),sizeof(type))))
 #define RENEW(var,newlen) (myrealloc(var,newlen))
 #define DELETE(var) (myfree(var,0))
-#define RELEASE(var) (DELETE(var),var=NULL)
+#define RELEASE(var) ((SLABBED(typeof(*(var)))?slab_free((var),sizeof(*(var))):DELETE(var)),var=NULL)
+
+//////////////////////////////////////////////////
+// Statistics counters. Each thread bumps its own shard (no atomics on the hot path, no
+// cache-line sharing); stat_read sums the live shards plus the totals of exited threads.
+//////////////////////////////////////////////////
+typedef enum { STAT_MALLOC,STAT_LTV,STAT_LTI,STAT_LTVR,STAT_REF,STAT_COUNTERS } STAT_COUNTER;
+
+typedef struct STAT_SHARD { struct STAT_SHARD *next,*prev; long count[STAT_COUNTERS]; int registered; } STAT_SHARD;
+
+extern __thread STAT_SHARD stat_shard;
+extern void stat_register();
+extern long stat_read(STAT_COUNTER counter);
+
+#define STAT_ADD(counter,n) ((void) (stat_shard.registered || (stat_register(),0)), \
+                             __atomic_store_n(&stat_shard.count[counter],stat_shard.count[counter]+(n),__ATOMIC_RELAXED))
 
 extern char *strstrip(char *buf,int *len);
 extern int fstrnprint(FILE *ofile,char *str,int len);
@@ -195,6 +233,26 @@ extern int fstrnprint(FILE *ofile,char *str,int len);
 extern char *bufdup(const char *buf,int len);
 extern char *stripdup(char *buf,int *len);
 
+// Interned strings: one shared, refcounted, null-terminated copy per distinct buffer. The returned
+// pointer is stable until the last strunintern, so equal interned strings compare equal by pointer.
+extern unsigned strnhash(const char *buf,int len);
+extern char *strintern(const char *buf,int len);
+extern void strunintern(char *str);
+extern unsigned strinterned_hash(char *str); // precomputed strnhash of an interned string
+extern int strinterned_len(char *str);
+
+// Pointer->pointer map (open addressing, insert-only); NULL keys aren't allowed.
+typedef struct {
+    struct { void *key,*val; } *slot;
+    unsigned mask,count;
+} PTRMAP;
+
+extern PTRMAP *ptrmap_init(PTRMAP *map,int size);
+extern void ptrmap_free(PTRMAP *map);
+extern void *ptrmap_get(PTRMAP *map,void *key);
+extern void *ptrmap_put(PTRMAP *map,void *key,void *val); // returns val, or NULL on allocation failure
+extern void *ptrmap_map(PTRMAP *map,void *(*op)(void *key,void *val)); // stops at first non-NULL op result
+
 extern int strtou(char *str,int len,unsigned *val);
 extern int strton(char *str,int len,long double *val);
 
@@ -203,6 +261,16 @@ extern int strnspn(char *str,int len,char *accept);
 extern int strncspn(char *str,int len,char *reject);
 extern int fnmatch_len(char *pat,int plen,char *str,int slen);
 
+typedef struct {
+    char *pat;  // not copied; NULL when nothing's compiled
+    int len;
+    int prefix; // literal lead, usable as a seek key into sorted names
+    int simple; // remainder is only '*', '?' and literals; no fnmatch needed
+} GLOB;
+
+extern GLOB *glob_compile(GLOB *glob,char *pat,int len);
+extern int glob_match(GLOB *glob,char *str,int len); // 0 on match, like fnmatch
+
 #ifndef FALSE
 #define FALSE 0
 #endif
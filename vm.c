@@ -41,6 +41,7 @@
 #include <stdlib.h>
 
 #include <pthread.h>
+#include <sched.h>
 #include <semaphore.h>
 #include <errno.h>
 
@@ -56,8 +57,6 @@
 #include "extensions.h"
 #include "trace.h"
 
-pthread_rwlock_t vm_rwlock = PTHREAD_RWLOCK_INITIALIZER;
-
 enum {
       VMRES_DICT,  // stack of dictionary frames
       VMRES_STACK, // stack of data stacks
@@ -132,8 +131,8 @@ static LTV *vm_deq(int res,int pop)  { return LTV_get(ENV_LIST(res),pop,HEAD,NUL
 
 LTV *vm_stack_enq(LTV *ltv) { return LTV_enq(LTV_list(vm_deq(VMRES_STACK,KEEP)),ltv,HEAD); }
 LTV *vm_stack_deq(int pop) { // walk stack hierarchy, getting/popping first TOS it finds
-    void *op(CLL *lnk) { return LTV_get(LTV_list(((LTVR *) lnk)->ltv),pop,HEAD,NULL,NULL); }
-    LTV *rval=CLL_map(ENV_LIST(VMRES_STACK),FWD,op);
+    void *op(LTV *frame) { return LTV_get(LTV_list(frame),pop,HEAD,NULL,NULL); }
+    LTV *rval=LTV_each(ENV_LIST(VMRES_STACK),FWD,op);
     return rval;
 }
 
@@ -155,8 +154,14 @@ void vm_throw(LTV *ltv) {
 // Specialized Utillties
 
 static LTV *vm_use_ext() {
-    if (!vm_env->ext && vm_env->ext_data)
-        vm_env->ext=LTV_init(NEW(LTV),vm_env->ext_data,vm_env->ext_length,vm_env->ext_flags);
+    if (!vm_env->ext && vm_env->ext_data) {
+        if (vm_env->ext_flags&LT_IMM) { // compiled-in immediate (e.g. a number); bytecode isn't aligned
+            void *imm=NULL;
+            memcpy(&imm,vm_env->ext_data,MIN(vm_env->ext_length,sizeof(imm)));
+            vm_env->ext=LTV_init(NEW(LTV),imm,0,vm_env->ext_flags);
+        } else
+            vm_env->ext=LTV_init(NEW(LTV),vm_env->ext_data,vm_env->ext_length,vm_env->ext_flags);
+    }
     return vm_env->ext;
 }
 
@@ -166,7 +171,7 @@ static void vm_listcat(int res) { // merge tos into head of nos
     THROW(!(tos = vm_deq(res, POP)), vm_exception);
     THROW(!(nos = vm_deq(res, KEEP)), vm_exception);
     THROW(!(tos->flags & LT_LIST && nos->flags & LT_LIST), vm_exception);
-    CLL_MERGE(LTV_list(nos),LTV_list(tos),HEAD);
+    LTV_merge(LTV_list(nos),LTV_list(tos),HEAD);
     LTV_release(tos);
  done:
     TFINISH(vm_env->state,"");
@@ -208,9 +213,8 @@ static void vm_code_pop() { DEBUG(fprintf(errfile(),CODE_RED "  vm_code_pop %x"
 static void vm_resolve_at(CLL *cll,LTV *ref) {
     TSTART(vm_env->state,"");
     int status=0;
-    LTV *resolve_ltv(LTV *dict) { return REF_resolve(dict,ref,FALSE)?NULL:REF_ltv(REF_HEAD(ref)); }
-    void *op(CLL *lnk) { return resolve_ltv(((LTVR *) lnk)->ltv); }
-    CLL_map(cll,FWD,op);
+    void *resolve_ltv(LTV *dict) { return REF_resolve(dict,ref,FALSE)?NULL:REF_ltv(REF_HEAD(ref)); }
+    LTV_each(cll,FWD,resolve_ltv);
  done:
     TFINISH(vm_env->state,"");
     return;
@@ -232,12 +236,64 @@ void vm_dump_ltv(LTV *ltv,char *label) {
     return;
 }
 
+static void vm_ffi_planned(LTV *lambda,CIF_PLAN *plan) { // args go straight from the stack into the call frame
+    LTV *argv[CIF_PLAN_ARGS]={},*result=NULL;
+    TSTART(vm_env->state,"");
+    for (int i=plan->arity;i--;) // last arg is on top
+        THROW(!(argv[i]=vm_stack_deq(POP)),vm_exception);
+    THROW(cif_plan_call(plan,lambda->data,argv,&result),vm_exception);
+    if (result)
+        THROW(!vm_stack_enq(result),vm_exception);
+ done:
+    for (int i=0;i<plan->arity;i++)
+        LTV_release(argv[i]);
+    TFINISH(vm_env->state,"");
+    return;
+}
+
+// Apply TOS's function across the lists/arrays beneath it, one per parameter. Planned signatures with a
+// curated "(T)*" result meta fill a C array (cif_plan_map); anything else takes cif_ffi_map and yields a list.
+static void vm_ffi_map() {
+    LTV *lambda=NULL,*ftype=NULL,**argv=NULL,*result=NULL;
+    CIF_PLAN *plan=NULL;
+    int arity=0;
+    int count(char *name,LTV *type) { arity++; return 0; }
+    TSTART(vm_env->state,"");
+    THROW(!(lambda=vm_stack_deq(POP)),vm_exception);
+    THROW(!(lambda->flags&LT_CVAR) || (lambda->flags&LT_TYPE),vm_exception);
+    THROW(!(ftype=LT_get(lambda,TYPE_BASE,HEAD,KEEP)),vm_exception);
+    if ((plan=cif_ffi_plan(ftype)) && plan->result && !cif_get_meta(plan->result))
+        plan=NULL; // nothing to type the result array with
+    if (plan)
+        arity=plan->arity;
+    else
+        THROW(cif_args_marshal(ftype,FWD,count),vm_exception);
+    THROW(!(argv=(LTV **) mybzero(mymalloc(sizeof(LTV *)*(arity+1)),sizeof(LTV *)*(arity+1))),vm_exception);
+    for (int i=arity;i--;) // last parameter's sequence is on top
+        THROW(!(argv[i]=vm_stack_deq(POP)),vm_exception);
+    THROW(plan?cif_plan_map(plan,lambda->data,argv,&result):cif_ffi_map(ftype,lambda->data,argv,arity,&result),vm_exception);
+    if (result)
+        THROW(!vm_stack_enq(result),vm_exception);
+ done:
+    for (int i=0;argv && i<arity;i++)
+        LTV_release(argv[i]);
+    DELETE(argv);
+    LTV_release(lambda);
+    TFINISH(vm_env->state,"");
+    return;
+}
+
 static void vm_ffi(LTV *lambda) {
     CLL args; CLL_init(&args); // list of ffi arguments
     LTV *ftype=NULL,*cif=NULL,*rval=NULL;
+    CIF_PLAN *plan=NULL;
     int void_func;
 
     THROW(!(ftype=LT_get(lambda,TYPE_BASE,HEAD,KEEP)),vm_exception);
+    if ((plan=cif_ffi_plan(ftype))) {
+        vm_ffi_planned(lambda,plan);
+        return;
+    }
     THROW(!(cif=cif_ffi_prep(ftype)),vm_exception);
 
     rval=cif_rval_create(ftype,NULL);
@@ -359,6 +415,21 @@ extern void encaps() {
     return;
 }
 
+extern void enlist(int n) { // replace the top n items with a list of them, deepest first
+    TSTART(vm_env->state,"");
+    LTV *list=LTV_NULL_LIST,*ltv=NULL;
+    while (n-- > 0) {
+        THROW(!(ltv=vm_stack_deq(POP)),vm_exception);
+        LTV_enq(LTV_list(list),ltv,HEAD);
+    }
+    THROW(!vm_stack_enq(list),vm_exception);
+    list=NULL;
+ done:
+    LTV_release(list);
+    TFINISH(vm_env->state,"");
+    return;
+}
+
 LTV *decaps_ltv(LTV *ltv) { return ltv; } // all the work is done via coersion
 
 extern void decaps() {
@@ -460,7 +531,7 @@ static void vmop_PUSHEXT() { VMOP_DEBUG();
         if ((dest=vm_stack_deq(KEEP)) && (dest->flags&LT_REFS) && (dest=vm_stack_deq(POP))) { // splice stack frame contents into ref
             if (!REF_lti(REF_HEAD(dest))) // create LTI if it's not already resolved
                 REF_resolve(vm_deq(VMRES_DICT,KEEP),dest,TRUE);
-            CLL_MERGE(&(REF_lti(REF_HEAD(dest))->ltvs),LTV_list(stack),REF_HEAD(dest)->reverse);
+            LTV_merge(&(REF_lti(REF_HEAD(dest))->ltvs),LTV_list(stack),REF_HEAD(dest)->reverse);
             vm_stack_enq(dest);
         }
     }
@@ -538,7 +609,7 @@ static void vmop_CTX_PUSH() { VMOP_DEBUG();
     if (vm_env->state) { DEBUG(fprintf(errfile(),"  (skipping %s)\n",__func__));
         vm_env->skipdepth++;
     } else {
-        THROW(!vm_enq(VMRES_STACK,LTV_NULL_LIST),vm_exception);
+        THROW(!vm_enq(VMRES_STACK,LTV_NULL_RING),vm_exception);
         THROW(!vm_enq(VMRES_DICT,vm_stack_deq(POP)),vm_exception);
     }
  done: return;
@@ -559,8 +630,8 @@ static void vmop_FUN_PUSH() { VMOP_DEBUG();
         vm_env->skipdepth++;
     } else {
         THROW(!vm_enq(VMRES_FUNC,vm_stack_deq(POP)),vm_exception);
-        THROW(!vm_enq(VMRES_STACK,LTV_NULL_LIST),vm_exception);
-        THROW(!vm_enq(VMRES_DICT,LTV_NULL),vm_exception);
+        THROW(!vm_enq(VMRES_STACK,LTV_NULL_RING),vm_exception);
+        THROW(!vm_enq(VMRES_DICT,LTV_NULL_HASH),vm_exception);
     }
  done: return;
 }
@@ -624,6 +695,12 @@ static void vmop_S2F() { VMOP_DEBUG();
  done: return;
 }
 
+static void vmop_MAP() { VMOP_DEBUG();
+    if (vm_env->state) return;
+    vm_ffi_map();
+ done: return;
+}
+
 //////////////////////////////////////////////////
 
 static void vmop_EXT() { VMOP_DEBUG();
@@ -649,7 +726,7 @@ static VMOP_CALL vmop_call[] = {
     vmop_PUSHEXT, vmop_EVAL,     vmop_REF,     vmop_DEREF,    vmop_ASSIGN,
     vmop_REMOVE,  vmop_CTX_PUSH, vmop_CTX_POP, vmop_FUN_PUSH, vmop_FUN_EVAL,
     vmop_FUN_POP, vmop_S2S,      vmop_D2S,     vmop_E2S,      vmop_F2S,
-    vmop_S2D,     vmop_S2E,      vmop_S2F,
+    vmop_S2D,     vmop_S2E,      vmop_S2F,      vmop_MAP,
 };
 
 /* no conditionals(!!) */
@@ -667,6 +744,7 @@ inner_loop:
     goto *inner[!vm_env->state];
 inner_exit:
     vm_env->state &= ~(VM_YIELD);
+    LTV_idle(); // yields are the VM's idle points
     goto *outer[!(vm_env->state & (VM_COMPLETE | VM_ERROR))];
 outer_exit:
     return vm_env->state;
@@ -689,10 +767,10 @@ void init_vm(LTV *dict) {
     {
         vm_env->state = 0;
 
-        for (int i = 0; i < VMRES_COUNT; i++)
-            LTV_init(&vm_env->ltv[i], NULL, 0, LT_NULL | LT_LIST);
+        for (int i = 0; i < VMRES_COUNT; i++) // code is walked by LTVR (code_ltvr), so stays linked
+            LTV_init(&vm_env->ltv[i], NULL, 0, LT_NULL | LT_LIST | (i == VMRES_CODE ? 0 : LT_RING));
 
-        STRY(!vm_enq(VMRES_STACK, LTV_NULL_LIST), "initializing env stack");
+        STRY(!vm_enq(VMRES_STACK, LTV_NULL_RING), "initializing env stack");
         STRY(!vm_enq(VMRES_DICT, env_cvar), "adding vm's env to it's own dict");
         STRY(!vm_enq(VMRES_DICT, dict), "adding user dict to vm env's dict");
     }
@@ -724,14 +802,14 @@ static void vm_closure_thunk(ffi_cif *CIF,void *RET,void **ARGS,void *USER_DATA)
     {
         vm_env->state=0;
 
-        for (int i=0;i<VMRES_COUNT;i++)
-            LTV_init(&vm_env->ltv[i],NULL,0,LT_NULL|LT_LIST);
+        for (int i=0;i<VMRES_COUNT;i++) // code is walked by LTVR (code_ltvr), so stays linked
+            LTV_init(&vm_env->ltv[i],NULL,0,LT_NULL|LT_LIST|(i==VMRES_CODE?0:LT_RING));
 
-        STRY(!vm_enq(VMRES_STACK,LTV_NULL_LIST),"initializing env stack");
+        STRY(!vm_enq(VMRES_STACK,LTV_NULL_RING),"initializing env stack");
         STRY(!vm_enq(VMRES_DICT, env_cvar), "adding vm's env to it's own dict");
         STRY(!vm_enq(VMRES_DICT, continuation), "adding continuation (w/ROOT,CODE) to env");
 
-        LTV *locals=LTV_init(NEW(LTV),"THUNK_LOCALS",-1,LT_NONE);
+        LTV *locals=LTV_init(NEW(LTV),"THUNK_LOCALS",-1,LT_NONE|LT_HASH);
         STRY(!vm_enq(VMRES_DICT,locals),"pushing locals into dict");
 
         int index=0;
@@ -769,6 +847,7 @@ extern pthread_t vm_async(LTV *continuation,LTV *arg) {
     pthread_t thread;
     pthread_attr_t attr={};
     pthread_attr_init(&attr);
+    lt_concurrent_enter(true); // ROOT, cif_module etc. are now shared, and the thread is detached; listree stays locked/RCU for good
     THROW(pthread_create(&thread,&attr,(vm_thunk) continuation->data,(void *) arg),vm_exception);
  done:
     return thread;
@@ -795,6 +874,8 @@ extern int vm_bootstrap(char *bootstrap) {
     LTV *rval=vm_eval(cif_module,LTV_init(NEW(LTV),bootstrap,-1,LT_NONE),LTV_NULL);
     if (rval)
         print_ltv(outfile(),"",rval,"\n",0);
+    while (LTV_reclaim(-1)) // finish any queued teardown, whoever holds it
+        sched_yield();
     printf("exiting...\n");
     return 0;
 }